@@ -1,3 +1,13 @@
 #!/bin/bash
 
-gcc -Wall -o find-regex.so find-regex.c $(yed --print-cflags) $(yed --print-ldflags)
+# build with the PCRE2 engine when the library is available
+if pcre2-config --libs8 > /dev/null 2>&1; then
+    PCRE2="-DFIND_HAVE_PCRE2 $(pcre2-config --cflags) $(pcre2-config --libs8)"
+fi
+
+# `./build.sh --bench' also builds in the find-regex-bench command
+if [ "$1" = "--bench" ]; then
+    BENCH="-DFIND_HAVE_BENCH"
+fi
+
+gcc -Wall -pthread -o find-regex.so find-regex.c $PCRE2 $BENCH $(yed --print-cflags) $(yed --print-ldflags)
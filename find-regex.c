@@ -1,10 +1,71 @@
 #include <yed/plugin.h>
 #include <yed/syntax.h>
 #include <regex.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <poll.h>
+#include <stdarg.h>
+#if defined(FIND_HAVE_BENCH) && defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#ifdef FIND_HAVE_PCRE2
+#define PCRE2_CODE_UNIT_WIDTH 8
+#include <pcre2.h>
+#endif
 
 #define FIND_DEFAULT_ARRAY_LEN 16
 #define FIND_DEFAULT_FIND_PROMPT "(find-in-buffer) "
 #define FIND_DEFAULT_REPLACE_PROMPT "(replace-current-search) "
+#define FIND_DEFAULT_CONFIRM_PROMPT "(replace? y/n/a/q) "
+#define FIND_DEFAULT_BACKGROUND_BUDGET_MS "4"
+#define FIND_DEFAULT_ENGINE "posix"
+#define FIND_DEFAULT_THREADS "1"
+#define FIND_DEFAULT_MAX_MATCHES "1000000"
+#define FIND_DEFAULT_HISTORY_PREFETCH "3"
+#define FIND_DEFAULT_SEARCH_BUDGET_MS "5000"
+#define FIND_DEFAULT_MAX_LINE_LENGTH "65536"
+/* more history patterns than this are never kept warm */
+#define FIND_MAX_HISTORY_PREFETCH 8
+#define FIND_SEARCH_CHUNK_ROWS 512
+/* the cache only grows past this while more patterns are in use */
+#define FIND_COMPILED_CACHE_LEN 16
+#define FIND_ARENA_BLOCK_LEN 4096
+/* ranges with fewer rows than this are never split across threads */
+#define FIND_PARALLEL_MIN_ROWS 32768
+#define FIND_MAX_THREADS 64
+/* PCRE2 gives up on a line, as if it didn't match, past these limits */
+#define FIND_PCRE2_MATCH_LIMIT 1000000
+#define FIND_PCRE2_DEPTH_LIMIT 10000
+#define FIND_RESULTS_BUFFER "*find-results"
+/* how much of a matching line is shown in the results buffer */
+#define FIND_RESULT_TEXT_MAX 256
+/* how much of a file each thread searches per step of `find-in-file-regex' */
+#define FIND_FILE_SLICE_LEN (1 << 20)
+#define FIND_REGION_BUFFER "*find-region"
+/* how much of a file is loaded on each side of a hit */
+#define FIND_REGION_LEN (64 * 1024)
+#define FIND_PREVIEW_BUFFER "*find-replace-preview"
+/* more changed lines than this are counted but not shown in the preview */
+#define FIND_PREVIEW_MAX_LINES 1000
+#define FIND_MAX_HIGHLIGHTS 8
+#define FIND_MAX_HIGHLIGHT_GROUPS 64
+#ifdef FIND_HAVE_BENCH
+#define FIND_BENCH_BUFFER "*find-bench"
+#define FIND_BENCH_TEXT_BUFFER "*find-bench-text"
+#define FIND_BENCH_DEFAULT_LINES 10000
+#define FIND_BENCH_SAMPLES 1000
+#define FIND_BENCH_FRAME_HEIGHT 50
+#define FIND_BENCH_FRAME_WIDTH 192
+#endif
 
 /**
  * PROPERTIES
@@ -14,37 +75,248 @@ typedef struct replace_properties {
     int is_all_lines;    /* replace matches on all lines? */
     int is_single_line;  /* replace only on a single line? */
     int is_confirm;      /* confirm before each replace? */
+    int is_preview;      /* show the replace and wait before changing anything? */
     int is_global;       /* replace multiple matches on each line? */
     int is_ignore_case;  /* ignore character case when searching? */
+    int is_template;     /* expand `\1'..`\9' and `&' in the replacement? */
     int start_line;      /* the starting and ending lines of the replacement */
     int end_line;
     array_t replacement; /* the string replacing the matches */
 } replace_properties;
 
-typedef struct matchframe {
-    /* which frame this holds information for */
-    yed_frame *yed_frame;
-    /* the matches pertaining to this frame */
+/*
+ * A replacement compiled into the literal text and match groups it is built
+ * from, so it is parsed once per replace rather than once per match.
+ */
+typedef struct replace_piece {
+    /* the group of the match to insert, or -1 for literal text */
+    int    group;
+    /* where the literal text is within the template's text */
+    size_t start;
+    size_t len;
+} replace_piece;
+
+typedef struct replace_template {
+    array_t text;
+    array_t pieces;
+    /* the highest group referred to, or -1 if there are no references */
+    int     max_group;
+} replace_template;
+
+/*
+ * The search of one buffer. Matches are kept per buffer so that every frame
+ * showing the buffer highlights from the same search.
+ */
+typedef struct matchbuffer {
+    /* which buffer this holds information for */
+    yed_buffer *buffer;
+    /* the matches pertaining to this buffer */
     array_t matches;
-} matchframe;
+    /* the pattern and line mode the matches were found with */
+    array_t pattern;
+    int is_global;
+    /*
+     * Rows [scan_lo, scan_hi] of the buffer have been searched. Everything
+     * outside of that range is searched lazily after the visible rows.
+     */
+    int scan_lo;
+    int scan_hi;
+    /*
+     * The search never goes outside of rows [range_lo, range_hi]. A
+     * range_hi of 0 means the search runs to the end of the buffer.
+     */
+    int range_lo;
+    int range_hi;
+    /* the id of the compiled pattern the matches were found with */
+    int compiled_id;
+    int is_ignore_case;
+    /*
+     * Once a search finds more than `find-regex-max-matches' matches, they
+     * are only counted. The matches of a row are found again whenever they
+     * are needed, i.e. to highlight, move to or replace them.
+     */
+    int is_capped;
+    int n_counted;
+    /*
+     * A warm matchbuffer holds the search of a recent history pattern that
+     * isn't shown. It is kept up to date like any other, so recalling the
+     * pattern swaps it in with its matches already found.
+     */
+    int is_warm;
+    /*
+     * A search that spends more than `find-regex-search-budget-ms' scanning is
+     * truncated: it stops where it is, and the matches found so far are all
+     * it has. Lines longer than `find-regex-max-line-length' are never
+     * searched, which `has_skipped' notes.
+     */
+    long long scan_us;
+    int is_truncated;
+    int has_skipped;
+    /*
+     * A frame may show rows far from the searched range, e.g. right after
+     * jumping to the end of the buffer. Those rows are searched on their own,
+     * into `view_matches', so drawing them never searches the rows in between;
+     * the background fills that gap. The segment is dropped once the
+     * searched range covers it, or when the buffer is edited.
+     */
+    array_t view_matches;
+    int view_lo;
+    int view_hi;
+} matchbuffer;
 
+/*
+ * Matches are kept by the million, so they are kept small: offsets within a
+ * line fit in 32 bits, leaving no padding.
+ */
 typedef struct match {
-    /* the line within the frame that this is a match for */
-    int line;
+    /* the line within the buffer that this is a match for */
+    int      line;
     /* offsets in the line where the match starts and ends */
-    size_t start;
-    size_t end;
+    uint32_t start;
+    uint32_t end;
 } match;
 
-/* all frames and the matches therein */
-static array_t _matchframes;
+/* all searched buffers and the matches therein */
+static array_t _matchbuffers;
+
+/* the matches of a single row of a capped buffer, found again on demand */
+static array_t _row_matches;
+
+/*
+ * A regex engine compiles the pattern and finds matches within a line. The
+ * engine used is picked by `find-regex-engine', except that patterns without
+ * metacharacters always use the literal engine.
+ */
+typedef struct find_engine {
+    const char *name;
+    /* characters that make a pattern more than a literal string */
+    const char *metachars;
+    /*
+     * How the engine writes `(a)|(b)', so several patterns can be matched as
+     * one, or NULL if it can't.
+     */
+    const char *group_open;
+    const char *group_close;
+    const char *alternation;
+    /*
+     * Compile the pattern into a state owned by the engine. Returns 0 on
+     * success, or an engine specific error status.
+     */
+    int  (*compile)(const char *pattern, int is_ignore_case, void **state);
+    /*
+     * Find the first match at or after `offset' in the `len' bytes of
+     * `line', which need not be NUL terminated. Fills up to `nmatches'
+     * groups, with offsets relative to the start of the line, and returns 0
+     * or REG_NOMATCH. `is_ascii', if it isn't NULL, keeps whether the line is
+     * all ASCII across the matches of one line, for the engines that need to
+     * know: -1 until it is known.
+     */
+    int  (*exec)(void *state, const char *line, size_t len, size_t offset, size_t nmatches,
+                 regmatch_t *matches, int *is_ascii);
+    /* the number of capture groups in the compiled pattern */
+    int  (*n_groups)(void *state);
+    void (*error)(int status);
+    void (*free)(void *state);
+} find_engine;
+
+/*
+ * A compiled pattern. Recently compiled patterns are kept in a small LRU cache
+ * keyed by the engine, pattern text and case mode, so searching again, going
+ * through the search history or replacing after a find don't recompile. A
+ * pattern that a search still uses is never evicted, so the cache grows past
+ * its length while more than that many are in use.
+ */
+typedef struct find_compiled {
+    /* unique for every compile */
+    int                id;
+    find_engine       *engine;
+    void              *state;
+    char              *pattern;
+    int                is_ignore_case;
+    unsigned long long last_used;
+} find_compiled;
+
+/* find_compiled*, malloced so that they stay put as the cache grows */
+static array_t            _compiled_cache;
+static int                _compiled_next_id = 1;
+static unsigned long long _compiled_clock;
 
 /*
  * the string pattern and its compiled representation. only one pattern (a
  * search) exists at a time.
  */
-static array_t _pattern;
-static regex_t _regex;
+static array_t        _pattern;
+static find_compiled *_compiled;
+/* the engine of the last compile, for reporting its errors */
+static find_engine   *_engine;
+
+/*
+ * An ignore case pattern made only of ASCII is also compiled with both cases
+ * of its letters spelled out, e.g. `[fF][oO][oO]', and lines of ASCII text are
+ * matched with that instead of REG_ICASE, which glibc runs through a much
+ * slower locale aware matcher. Other lines still use `regex'. Without
+ * REG_STARTEND, `scratch' holds a terminated copy of the line being matched;
+ * each thread compiles its own state, so it is never shared.
+ */
+typedef struct find_posix {
+    regex_t regex;
+    regex_t folded;
+    int     has_folded;
+#ifndef REG_STARTEND
+    array_t scratch;
+#endif
+} find_posix;
+
+/*
+ * Patterns without any metacharacters are matched as plain substrings with
+ * Boyer-Moore-Horspool instead of going through regexec. `text' holds the
+ * pattern, case folded if the match ignores case, and `skip' the shift for
+ * each (folded) byte of the text.
+ */
+typedef struct find_literal {
+    size_t               len;
+    char                *text;
+    size_t               skip[256];
+    const unsigned char *fold;
+} find_literal;
+
+/* byte translation tables used by the literal matcher */
+static unsigned char _fold_none[256];
+static unsigned char _fold_ascii[256];
+
+/*
+ * The buffer whose matches are being replaced. The edits made by the replace
+ * don't update its matches; the replace fixes them up itself once it is done.
+ */
+static matchbuffer *_replacing_matchbuffer;
+
+/*
+ * The new text of every line a replace changes, all worked out before the
+ * buffer is touched, and then set in a single undo record. A replace with the
+ * 'p' option keeps it, and shows it in the preview buffer, until
+ * `find-regex-replace-apply'. Any edit of the buffer in the meantime throws
+ * it away, since its rows may no longer be the right ones.
+ */
+typedef struct find_replace_batch {
+    /* NULL when there is no replace waiting */
+    yed_buffer *buffer;
+    /* the row of each changed line, and where its new text starts in `text' */
+    array_t     rows;
+    array_t     offsets;
+    array_t     text;
+    int         n_matches;
+    int         is_applying;
+} find_replace_batch;
+
+static find_replace_batch _replace_batch;
+
+static void find_replace_batch_clear() {
+    _replace_batch.buffer = NULL;
+    array_clear(_replace_batch.rows);
+    array_clear(_replace_batch.offsets);
+    array_clear(_replace_batch.text);
+    _replace_batch.n_matches = 0;
+}
 
 /*
  * Used globally to hold replacement data. This data can be built
@@ -52,11 +324,80 @@ static regex_t _regex;
  */
 static replace_properties _replace_properties;
 
+/* The compiled form of the replacement of the replace being done. */
+static replace_template _replace_template;
+
 yed_cmd_line_readline_ptr_t  _search_readline;
 array_t _search_hist;
 static int _search_save_row;
 static int _search_save_col;
 
+/*
+ * A search across every open buffer, every file under a directory, or one
+ * single file. Hits are streamed into the results buffer a few targets at a
+ * time from the pump, one line per matching line, as `name:row:col: text'.
+ */
+typedef struct find_project_search {
+    int     is_active;
+    /* the id of the compiled pattern, which is kept while the search is on */
+    int     compiled_id;
+    /* yed_buffer* and char* (malloced paths) still to be searched */
+    array_t buffers;
+    array_t paths;
+    /* the rows of the last of `buffers' already searched, a chunk at a time */
+    int     n_buffer_rows;
+    int     n_hits;
+    int     n_searched;
+    /*
+     * A single file searched a slice of bytes per thread at a time, instead
+     * of all at once, since it may be far too large to search in one go.
+     * `file_line' is the line at `file_offset', counting from 1. Hits past
+     * the cap of find-regex-max-matches are only counted in `n_unlisted'.
+     */
+    char        *file_path;
+    char        *file_data;
+    size_t       file_size;
+    size_t       file_offset;
+    long long    file_line;
+    find_engine *file_engine;
+    /* one copy of the pattern per thread, the first is the cached one's */
+    void        *file_states[FIND_MAX_THREADS];
+    int          n_file_states;
+    int          n_unlisted;
+    int          n_skipped;
+} find_project_search;
+
+static find_project_search _project_search;
+
+/*
+ * A replace that asks before each match. Only the next match is ever looked
+ * for, from just past the last one, wrapping around the range once.
+ */
+typedef struct find_confirm {
+    /* looked up again on every key, since matchbuffers move around */
+    yed_buffer  *buffer;
+    matchbuffer *mb;
+    yed_frame   *frame;
+    /* the match being asked about */
+    match        current;
+    /*
+     * Where the last match, or its replacement, ended. An empty match there
+     * isn't one of its own, as in find_line_iter, so a pattern like `$' or
+     * `a*' doesn't match again just past its own replacement.
+     */
+    int          prev_line;
+    size_t       prev_end;
+    /* where the replace began, and so where it ends after wrapping */
+    int          start_row;
+    size_t       start_col;
+    int          is_wrapped;
+    int          n_replaced;
+    int          is_recording;
+    array_t      text;
+} find_confirm;
+
+static find_confirm _confirm;
+
 enum find_command {
     FIND_IN_BUFFER,
     REPLACE_CURRENT_SEARCH,
@@ -108,11 +449,175 @@ void find_array_terminate(array_t *arr) {
 
 void find_array_replace(array_t *arr, char *s) {
     array_clear(*arr);
-    for (int i = 0; s[i] != '\0'; i++)
-        array_push(*arr, s[i]);
+    array_push_n(*arr, s, strlen(s));
     find_array_terminate(arr);
 }
 
+static inline long long find_time_now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * ARENA
+ */
+
+/*
+ * Short-lived allocations, like the pieces of a parsed expression or the jobs
+ * of a parallel scan, are bumped out of one block instead of being freed one
+ * by one. Everything is dropped at once at the end of each update of the
+ * editor, so nothing from the arena may be kept past the operation that made
+ * it. Only the main thread allocates from it.
+ */
+typedef struct find_arena {
+    char    *block;
+    size_t   used;
+    size_t   cap;
+    /* blocks outgrown since the last reset */
+    array_t  retired;
+} find_arena;
+
+static find_arena _arena;
+
+static void* find_arena_alloc(size_t size) {
+    size_t cap;
+    void  *p;
+
+    size = (size + 15) & ~(size_t)15;
+    if (_arena.used + size > _arena.cap) {
+        if (_arena.block)
+            array_push(_arena.retired, _arena.block);
+        cap = _arena.cap ? _arena.cap * 2 : FIND_ARENA_BLOCK_LEN;
+        while (cap < size)
+            cap *= 2;
+        _arena.block = malloc(cap);
+        _arena.cap = cap;
+        _arena.used = 0;
+    }
+
+    p = _arena.block + _arena.used;
+    _arena.used += size;
+    return p;
+}
+
+static void* find_arena_calloc(size_t n, size_t size) {
+    void *p;
+
+    p = find_arena_alloc(n * size);
+    memset(p, 0, n * size);
+    return p;
+}
+
+static char* find_arena_strndup(const char *s, size_t len) {
+    char *p;
+
+    p = find_arena_alloc(len + 1);
+    memcpy(p, s, len);
+    p[len] = '\0';
+    return p;
+}
+
+/*
+ * Drop everything allocated since the last reset. The newest block is the
+ * largest, so it's kept and an arena that has grown big enough for a typical
+ * update stops calling malloc.
+ */
+static void find_arena_reset() {
+    char **block;
+
+    array_traverse(_arena.retired, block) {
+        free(*block);
+    }
+    array_clear(_arena.retired);
+    _arena.used = 0;
+}
+
+static void find_arena_free() {
+    find_arena_reset();
+    free(_arena.block);
+    array_free(_arena.retired);
+}
+
+/**
+ * STATS
+ */
+
+/*
+ * Where the time of searching goes, only kept while find-regex-stats-enabled
+ * is true. The variable is read once per update into `is_enabled', so with
+ * stats off each step that is counted costs a branch. Counts are since the
+ * plugin was loaded or `find-regex-stats reset'.
+ */
+typedef struct find_stats {
+    int       is_enabled;
+    long long compile_ns;
+    long long n_compiles;
+    long long n_cache_hits;
+    long long scan_ns;
+    long long n_lines_scanned;
+    long long n_matches;
+    long long replace_ns;
+    long long n_lines_replaced;
+    long long highlight_ns;
+    long long n_highlights;
+} find_stats;
+
+static find_stats _stats;
+
+/* The time a step starts, or 0 with stats off. */
+static inline long long find_stats_start() {
+    struct timespec ts;
+
+    if (!_stats.is_enabled)
+        return 0;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Add the time since `start' to `total'. Only called with stats on. */
+static inline void find_stats_stop(long long start, long long *total) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    *total += (long long)ts.tv_sec * 1000000000 + ts.tv_nsec - start;
+}
+
+static void find_stats_reset() {
+    int is_enabled;
+
+    is_enabled = _stats.is_enabled;
+    memset(&_stats, 0, sizeof(_stats));
+    _stats.is_enabled = is_enabled;
+}
+
+static void find_stats_set_var(char *name, const char *fmt, ...) {
+    va_list  args;
+    char     value[32];
+    char    *old;
+
+    va_start(args, fmt);
+    vsnprintf(value, sizeof(value), fmt, args);
+    va_end(args);
+
+    old = yed_get_var(name);
+    if (!old || strcmp(old, value) != 0)
+        yed_set_var(name, value);
+}
+
+/* Set the find-regex-stats-* variables, for the status line. */
+static void find_stats_publish() {
+    find_stats_set_var("find-regex-stats-compiles",       "%lld", _stats.n_compiles);
+    find_stats_set_var("find-regex-stats-compile-ms",     "%.2f", _stats.compile_ns / 1e6);
+    find_stats_set_var("find-regex-stats-scan-ms",        "%.2f", _stats.scan_ns / 1e6);
+    find_stats_set_var("find-regex-stats-lines-scanned",  "%lld", _stats.n_lines_scanned);
+    find_stats_set_var("find-regex-stats-matches",        "%lld", _stats.n_matches);
+    find_stats_set_var("find-regex-stats-replace-ms",     "%.2f", _stats.replace_ns / 1e6);
+    find_stats_set_var("find-regex-stats-lines-replaced", "%lld", _stats.n_lines_replaced);
+    find_stats_set_var("find-regex-stats-highlight-ms",   "%.2f", _stats.highlight_ns / 1e6);
+    find_stats_set_var("find-regex-stats-highlights",     "%lld", _stats.n_highlights);
+}
+
 /**
  * REPLACE PROPERTIES
  */
@@ -122,7 +627,9 @@ replace_properties* find_replace_properties_reset() {
     _replace_properties.is_single_line = 0;
     _replace_properties.is_global = 0;
     _replace_properties.is_confirm = 0;
+    _replace_properties.is_preview = 0;
     _replace_properties.is_ignore_case = 0;
+    _replace_properties.is_template = 0;
     _replace_properties.start_line = -1;
     _replace_properties.end_line = -1;
     array_clear(_replace_properties.replacement);
@@ -133,6 +640,83 @@ replace_properties* find_replace_properties_get() {
     return &_replace_properties;
 }
 
+static void find_replace_template_push_piece(replace_template *t, int group, size_t start) {
+    replace_piece piece;
+
+    piece.group = group;
+    piece.start = start;
+    piece.len = array_len(t->text) - start;
+    if (group < 0 && piece.len == 0)
+        return;
+    array_push(t->pieces, piece);
+}
+
+/*
+ * Compile `replacement' into `t'. As a template, `&' is the whole match,
+ * `\1'..`\9' are the groups of the match and a backslash makes the character
+ * after it literal. Otherwise, the replacement is all literal text.
+ */
+static void find_replace_template_compile(replace_template *t, char *replacement, int is_template) {
+    char   *p;
+    size_t  start;
+    int     group;
+
+    array_clear(t->text);
+    array_clear(t->pieces);
+    t->max_group = -1;
+    start = 0;
+
+    for (p = replacement; *p != '\0'; p++) {
+        if (!is_template) {
+            array_push(t->text, *p);
+            continue;
+        }
+
+        if (*p == '&') {
+            group = 0;
+        } else if (p[0] == '\\' && isdigit((unsigned char)p[1])) {
+            group = *++p - '0';
+        } else {
+            if (p[0] == '\\' && p[1] != '\0')
+                p++;
+            array_push(t->text, *p);
+            continue;
+        }
+
+        find_replace_template_push_piece(t, -1, start);
+        find_replace_template_push_piece(t, group, 0);
+        start = array_len(t->text);
+        if (group > t->max_group)
+            t->max_group = group;
+    }
+
+    find_replace_template_push_piece(t, -1, start);
+}
+
+/*
+ * Add the replacement for one match of `text' to `out', with `groups' holding
+ * up to `max_group' groups of the match.
+ */
+static void find_replace_template_expand(replace_template *t,
+                                         char *text,
+                                         regmatch_t *groups,
+                                         array_t *out)
+{
+    replace_piece *piece;
+    regmatch_t    *g;
+
+    array_traverse(t->pieces, piece) {
+        if (piece->group < 0) {
+            array_push_n(*out, ((char*)array_data(t->text)) + piece->start, piece->len);
+            continue;
+        }
+        g = &groups[piece->group];
+        /* a group that took no part in the match inserts nothing */
+        if (g->rm_so >= 0 && g->rm_eo > g->rm_so)
+            array_push_n(*out, text + g->rm_so, g->rm_eo - g->rm_so);
+    }
+}
+
 /**
  * PATTERN
  */
@@ -192,346 +776,4253 @@ static inline void find_pattern_error(const int status) {
     }
 }
 
-int find_pattern_compile(int is_ignore_case) {
-    int flags = 0;
-    if (is_ignore_case)
-        flags |= REG_ICASE;
-    return regcomp(&_regex, array_data(_pattern), flags);
-}
-
 /**
- * MATCHFRAME
+ * ENGINES
  */
 
-static inline matchframe* find_matchframe_create(yed_frame *frame) {
-    matchframe mf;
-    mf.yed_frame = frame;
-    mf.matches = array_make_with_cap(match, FIND_DEFAULT_ARRAY_LEN);
-    array_push(_matchframes, mf);
-    return array_last(_matchframes);
+void find_fold_tables_init() {
+    for (int i = 0; i < 256; i++) {
+        _fold_none[i] = i;
+        _fold_ascii[i] = (i >= 'A' && i <= 'Z') ? (i - 'A' + 'a') : i;
+    }
 }
 
-static inline matchframe* find_matchframe_get(yed_frame *frame) {
-    matchframe *mf;
-    array_traverse(_matchframes, mf) {
-        if (mf->yed_frame == frame)
-            return mf;
+static int find_pattern_is_ascii(const char *pattern) {
+    for (int i = 0; pattern[i] != '\0'; i++) {
+        if ((unsigned char)pattern[i] >= 128)
+            return 0;
     }
-    return NULL;
+    return 1;
 }
 
-static inline matchframe* find_matchframe_get_or_create(yed_frame *frame) {
-    matchframe *mf = find_matchframe_get(frame);
-    if (!mf)
-        mf = find_matchframe_create(frame);
-    return mf;
+/* The other case of the ASCII letter `c', or 0 if it isn't one. */
+static inline char find_ascii_other_case(char c) {
+    if (c >= 'a' && c <= 'z')
+        return c - 'a' + 'A';
+    if (c >= 'A' && c <= 'Z')
+        return c - 'A' + 'a';
+    return 0;
 }
 
-static void find_matchframe_clear(matchframe *mf) {
-    array_clear(mf->matches);
-}
+static inline int find_text_is_ascii(const char *text, size_t len) {
+    uint64_t word;
+    size_t   i;
 
-static int find_matchframe_num_matches(matchframe *mf) {
-    return array_len(mf->matches);
+    for (i = 0; i + sizeof(word) <= len; i += sizeof(word)) {
+        memcpy(&word, text + i, sizeof(word));
+        if (word & 0x8080808080808080ULL)
+            return 0;
+    }
+    for (; i < len; i++) {
+        if ((unsigned char)text[i] >= 128)
+            return 0;
+    }
+    return 1;
 }
 
-void find_matchframe_highlight_handler(yed_event *event) {
-    matchframe *mf;
-    match      *m;
-    yed_attrs  *attr, search, search_cursor, *set;
-    yed_frame  *frame;
+/*
+ * Write the basic regular expression `pattern' to `out' with both cases of its
+ * letters spelled out. Returns 0 if it can't be: back references, which
+ * REG_ICASE compares ignoring case, escaped letters like `\Z', ranges that
+ * cover letters but don't run between two letters of the same case,
+ * equivalence classes, collating symbols and unclosed brackets (which regcomp
+ * reports) are left to REG_ICASE.
+ */
+static int find_posix_fold_pattern(const char *pattern, array_t *out) {
+    char *p, *end;
+    char  other, lo, hi;
+
+    p = (char*)pattern;
+    while (*p != '\0') {
+        if (*p == '\\') {
+            if (p[1] == '\0' || (p[1] >= '1' && p[1] <= '9') || find_ascii_other_case(p[1]))
+                return 0;
+            array_push_n(*out, p, 2);
+            p += 2;
+            continue;
+        }
 
-    if (!event->frame)
-        return;
+        if (*p != '[') {
+            other = find_ascii_other_case(*p);
+            if (other) {
+                array_push(*out, "["[0]);
+                array_push(*out, *p);
+                array_push(*out, other);
+                array_push(*out, "]"[0]);
+            } else {
+                array_push(*out, *p);
+            }
+            p += 1;
+            continue;
+        }
 
-    /* if we don't have any matches for this frame, go next */
-    mf = find_matchframe_get(event->frame);
-    if (!mf)
-        return;
+        /* bracket expression; a `]' right after the `[' or `[^' is literal */
+        array_push(*out, *p);
+        p += 1;
+        if (*p == '^') {
+            array_push(*out, *p);
+            p += 1;
+        }
+        if (*p == ']') {
+            array_push(*out, *p);
+            p += 1;
+        }
+        while (*p != ']') {
+            if (*p == '\0')
+                return 0;
+
+            if (p[0] == '[' && (p[1] == '=' || p[1] == '.')) {
+                /* equivalence classes and collating symbols */
+                return 0;
+            } else if (p[0] == '[' && p[1] == ':') {
+                end = strstr(p + 2, ":]");
+                if (!end)
+                    return 0;
+                array_push_n(*out, p, end + 2 - p);
+                /* ignoring case, either of these matches every cased letter */
+                if (strncmp(p, "[:upper:]", 9) == 0)
+                    array_push_n(*out, "[:lower:]", 9);
+                else if (strncmp(p, "[:lower:]", 9) == 0)
+                    array_push_n(*out, "[:upper:]", 9);
+                p = end + 2;
+            } else if (p[1] == '-' && p[2] != ']' && p[2] != '\0') {
+                if (p[2] == '[')
+                    return 0;
+                array_push_n(*out, p, 3);
+                if (find_ascii_other_case(p[0]) && find_ascii_other_case(p[2])) {
+                    if ((p[0] <= 'Z') != (p[2] <= 'Z'))
+                        return 0;
+                    lo = find_ascii_other_case(p[0]);
+                    hi = find_ascii_other_case(p[2]);
+                    array_push(*out, lo);
+                    array_push(*out, "-"[0]);
+                    array_push(*out, hi);
+                } else if (((unsigned char)p[0] <= 'Z' && (unsigned char)p[2] >= 'A')
+                       ||  ((unsigned char)p[0] <= 'z' && (unsigned char)p[2] >= 'a')) {
+                    return 0;
+                }
+                p += 3;
+            } else {
+                array_push(*out, *p);
+                other = find_ascii_other_case(*p);
+                if (other)
+                    array_push(*out, other);
+                p += 1;
+            }
+        }
+        array_push(*out, *p);
+        p += 1;
+    }
+    find_array_terminate(out);
+    return 1;
+}
 
-    frame = mf->yed_frame;
-    if (frame != ys->active_frame || !frame->buffer)
-        return;
+static int find_posix_compile(const char *pattern, int is_ignore_case, void **state) {
+    find_posix *re;
+    array_t     folded;
+    int         flags;
+    int         status;
 
+    flags = 0;
+    if (is_ignore_case)
+        flags |= REG_ICASE;
 
-    /* get the current styles for the search and search cursor */
-    search        = yed_active_style_get_search();
-    search_cursor = yed_active_style_get_search_cursor();
+    re = malloc(sizeof(*re));
+    status = regcomp(&re->regex, pattern, flags);
+    if (status != 0) {
+        free(re);
+        return status;
+    }
 
-    array_traverse(mf->matches, m) {
-        if (m->line != event->row)
-            continue;
-        for (unsigned col = m->start; col < m->end; col++) {
-            /* if cursor is within the match, use its style */
-            set = (event->row == frame->cursor_line && col == frame->cursor_col - 1)
-                        ? &search_cursor
-                        : &search;
-            /* set the search styles or just raw highlight if not styling */
-            attr = array_item(event->line_attrs, col);
-            if (ys->active_style) {
-                yed_combine_attrs(attr, set);
-            } else {
-                attr->flags ^= ATTR_INVERSE;
-            }
-        }
+    re->has_folded = 0;
+    if (is_ignore_case && find_pattern_is_ascii(pattern)) {
+        folded = array_make_with_cap(char, 4 * strlen(pattern) + 1);
+        if (find_posix_fold_pattern(pattern, &folded))
+            re->has_folded = (regcomp(&re->folded, array_data(folded), 0) == 0);
+        array_free(folded);
     }
+
+#ifndef REG_STARTEND
+    re->scratch = array_make_with_cap(char, FIND_DEFAULT_ARRAY_LEN);
+#endif
+    *state = re;
+    return 0;
 }
 
 /*
- * Given row and column `r', `c', search for nearest match in a particular
- * direction (up or down the buffer). Sets the position of the match in `row'
- * and `col' and returns 1 if there are matches. Otherwise, `row' and `col' are
- * not touched and this returns 0.
- */
-int find_matchframe_cursor_nearest_match(matchframe *mf,
-                                         int r,
-                                         int c,
-                                         int *row,
-                                         int *col,
-                                         int direction)
+ * Line text is matched in place, without a NUL terminator. With REG_STARTEND
+ * regexec is told where the text ends, otherwise it is copied into the
+ * state's scratch buffer, which is reused for every line.
+ */
+static int find_posix_exec(void *state,
+                           const char *line,
+                           size_t len,
+                           size_t offset,
+                           size_t nmatches,
+                           regmatch_t *matches,
+                           int *is_ascii)
 {
-    match *m;
-
-    if (find_matchframe_num_matches(mf) == 0) {
-        if (find_pattern_exists())
-            find_pattern_bad();
-        return 1;
+    find_posix *re;
+    regex_t    *regex;
+    int         status;
+    int         flags;
+    int         ascii;
+
+    re = state;
+    regex = &re->regex;
+    if (re->has_folded) {
+        /* the line is only looked through once, whatever its number of matches */
+        ascii = is_ascii ? *is_ascii : -1;
+        if (ascii < 0) {
+            ascii = find_text_is_ascii(line, len);
+            if (is_ascii)
+                *is_ascii = ascii;
+        }
+        if (ascii)
+            regex = &re->folded;
     }
 
+    /* past the start of the line, `^' must not match again */
+    flags = (offset > 0) ? REG_NOTBOL : 0;
+
+#ifdef REG_STARTEND
     /*
-     * This relies on the fact that the array of matches is in sorted order in
-     * terms of row and column because matches are found linearly through the
-     * buffer.
+     * The whole line is passed so word boundaries at the offset can see the
+     * text before it. The offsets that come back are from the line's start.
      */
+    matches[0].rm_so = offset;
+    matches[0].rm_eo = len;
+    status = regexec(regex, line, nmatches, matches, flags | REG_STARTEND);
+    if (status != 0)
+        return status;
+#else
+    array_clear(re->scratch);
+    if (len > offset)
+        array_push_n(re->scratch, (char*)line + offset, len - offset);
+    find_array_terminate(&re->scratch);
+    status = regexec(regex, array_data(re->scratch), nmatches, matches, flags);
+    if (status != 0)
+        return status;
+
+    for (size_t i = 0; i < nmatches; i++) {
+        if (matches[i].rm_so == -1)
+            continue;
+        matches[i].rm_so += offset;
+        matches[i].rm_eo += offset;
+    }
+#endif
+    return 0;
+}
 
-    if (direction > 0) {
-        array_traverse(mf->matches, m) {
-            if (m->line == r && m->start > c)
-                goto found;
-            if (m->line > r)
-                goto found;
-        }
-        m = array_item(mf->matches, 0);
-        yed_cprint("Search hit bottom, continuing at top");
+static int find_posix_n_groups(void *state) {
+    return ((find_posix*)state)->regex.re_nsub;
+}
+
+static void find_posix_free(void *state) {
+    find_posix *re;
+
+    re = state;
+    regfree(&re->regex);
+    if (re->has_folded)
+        regfree(&re->folded);
+#ifndef REG_STARTEND
+    array_free(re->scratch);
+#endif
+    free(re);
+}
+
+/*
+ * The literal engine only ignores case for ASCII patterns, so anything else
+ * is left to the configured engine.
+ */
+static int find_literal_compile(const char *pattern, int is_ignore_case, void **state) {
+    find_literal *lit;
+
+    lit = malloc(sizeof(*lit));
+    lit->fold = is_ignore_case ? _fold_ascii : _fold_none;
+    lit->len = strlen(pattern);
+    lit->text = malloc(lit->len + 1);
+    for (size_t i = 0; i < lit->len; i++)
+        lit->text[i] = lit->fold[(unsigned char)pattern[i]];
+    lit->text[lit->len] = '\0';
+
+    for (int i = 0; i < 256; i++)
+        lit->skip[i] = lit->len;
+    for (size_t i = 0; i + 1 < lit->len; i++)
+        lit->skip[(unsigned char)lit->text[i]] = lit->len - 1 - i;
+
+    *state = lit;
+    return 0;
+}
+
+/* Find the first occurrence of the literal pattern at or after `offset'. */
+static int find_literal_exec(void *state,
+                             const char *line,
+                             size_t len,
+                             size_t offset,
+                             size_t nmatches,
+                             regmatch_t *matches,
+                             int *is_ascii)
+{
+    find_literal        *lit;
+    const unsigned char *text, *pat, *fold, *found;
+    size_t               m, i, j;
+
+    lit = state;
+    text = (const unsigned char*)line;
+    pat = (const unsigned char*)lit->text;
+    fold = lit->fold;
+    m = lit->len;
+
+    for (i = 1; i < nmatches; i++)
+        matches[i].rm_so = matches[i].rm_eo = -1;
+
+    if (m == 0) {
+        matches[0].rm_so = matches[0].rm_eo = offset;
+        return 0;
     }
-    else {
-        array_rtraverse(mf->matches, m) {
-            if (m->line == r && m->start < c - 1)
-                goto found;
-            if (m->line < r)
-                goto found;
+
+    /* a single case-sensitive byte is best left to memchr */
+    if (m == 1 && fold == _fold_none) {
+        found = memchr(text + offset, pat[0], len - offset);
+        if (!found)
+            return REG_NOMATCH;
+        matches[0].rm_so = found - text;
+        matches[0].rm_eo = matches[0].rm_so + 1;
+        return 0;
+    }
+
+    i = offset;
+    while (i + m <= len) {
+        j = m - 1;
+        while (fold[text[i + j]] == pat[j]) {
+            if (j == 0) {
+                matches[0].rm_so = i;
+                matches[0].rm_eo = i + m;
+                return 0;
+            }
+            j--;
         }
-        m = array_last(mf->matches);
-        yed_cprint("Search hit top, continuing at bottom");
+        i += lit->skip[fold[text[i + m - 1]]];
     }
 
-found:
-    *row = m->line;
-    *col = m->start + 1;
+    return REG_NOMATCH;
+}
+
+static int find_literal_n_groups(void *state) {
+    return 0;
+}
+
+static void find_literal_error(int status) { }
+
+static void find_literal_free(void *state) {
+    free(((find_literal*)state)->text);
+    free(state);
+}
+
+#ifdef FIND_HAVE_PCRE2
+typedef struct find_pcre2 {
+    pcre2_code          *code;
+    pcre2_match_data    *match_data;
+    pcre2_match_context *match_context;
+    int                  is_jit;
+} find_pcre2;
+
+static void find_pcre2_free(void *state) {
+    find_pcre2 *re = state;
+
+    pcre2_match_context_free(re->match_context);
+    pcre2_match_data_free(re->match_data);
+    pcre2_code_free(re->code);
+    free(re);
+}
+
+static int find_pcre2_compile(const char *pattern, int is_ignore_case, void **state) {
+    find_pcre2 *re;
+    PCRE2_SIZE  error_offset;
+    uint32_t    options;
+    int         error;
+
+    options = 0;
+    if (is_ignore_case)
+        options |= PCRE2_CASELESS;
+
+    re = malloc(sizeof(*re));
+    re->code = pcre2_compile((PCRE2_SPTR)pattern, PCRE2_ZERO_TERMINATED,
+                             options, &error, &error_offset, NULL);
+    if (!re->code) {
+        free(re);
+        return error;
+    }
+
+    /* without JIT support this falls back to the interpreter */
+    re->is_jit = (pcre2_jit_compile(re->code, PCRE2_JIT_COMPLETE) == 0);
+    re->match_data = pcre2_match_data_create_from_pattern(re->code, NULL);
+
+    /* a pattern that backtracks badly can't hold up the scan on one line */
+    re->match_context = pcre2_match_context_create(NULL);
+    pcre2_set_match_limit(re->match_context, FIND_PCRE2_MATCH_LIMIT);
+    pcre2_set_depth_limit(re->match_context, FIND_PCRE2_DEPTH_LIMIT);
+    *state = re;
     return 0;
 }
 
-static inline int find_matchframe_push_match(matchframe *mf,
-                                             int row,
-                                             int offset,
-                                             int nmatches,
-                                             regmatch_t *matches)
+static int find_pcre2_exec(void *state,
+                           const char *line,
+                           size_t len,
+                           size_t offset,
+                           size_t nmatches,
+                           regmatch_t *matches,
+                           int *is_ascii)
 {
-    /*
-     * Right now we're just using the first item in the array regardless of
-     * length. Once we configure subexpressions (for replacing, later on), we
-     * will revist this.
-     */
-    match m;
-    m.line = row;
-    m.start = matches[0].rm_so + offset;
-    m.end = matches[0].rm_eo + offset;
+    find_pcre2 *re;
+    PCRE2_SIZE *ovector;
+    int         rc;
+
+    re = state;
+    if (re->is_jit)
+        rc = pcre2_jit_match(re->code, (PCRE2_SPTR)line, len, offset, 0,
+                             re->match_data, re->match_context);
+    else
+        rc = pcre2_match(re->code, (PCRE2_SPTR)line, len, offset, 0,
+                         re->match_data, re->match_context);
+    if (rc < 0)
+        return REG_NOMATCH;
+
+    ovector = pcre2_get_ovector_pointer(re->match_data);
+    for (size_t i = 0; i < nmatches; i++) {
+        if (i < (size_t)rc && ovector[2 * i] != PCRE2_UNSET) {
+            matches[i].rm_so = ovector[2 * i];
+            matches[i].rm_eo = ovector[2 * i + 1];
+        } else {
+            matches[i].rm_so = matches[i].rm_eo = -1;
+        }
+    }
+    return 0;
+}
 
-    array_grow_if_needed(mf->matches);
-    array_push(mf->matches, m);
+static int find_pcre2_n_groups(void *state) {
+    uint32_t count;
 
-    /* returns an offset to where the line should be searched from next */
-    return matches[0].rm_eo + 1;
+    if (pcre2_pattern_info(((find_pcre2*)state)->code, PCRE2_INFO_CAPTURECOUNT, &count) != 0)
+        return 0;
+    return count;
 }
 
-int find_matchframe_search_in_buffer(matchframe *mf, int is_global) {
-    /* TODO: execute flags */
-    static const int flags = 0;
-    /*
-     * Right now we only have one matching buffer. For matching subexpressions
-     * we would have to pass more, but I'm not sure how to get the number of
-     * matches an expression matched.
-     */
-    static const size_t nmatches = 1;
+static void find_pcre2_error(int status) {
+    PCRE2_UCHAR buff[256];
 
-    regmatch_t  match[nmatches];
-    int         status;
-    int         row;
-    char       *line;
-    int         len;
-    int         offset;
+    pcre2_get_error_message(status, buff, sizeof(buff));
+    yed_cerr("[FIND] %s", (char*)buff);
+}
+#endif
+
+static find_engine _engines[] = {
+    {
+        "posix", "\\.[]*^$",
+#ifdef __GLIBC__
+        /* alternation is a GNU extension of basic regular expressions */
+        "\\(", "\\)", "\\|",
+#else
+        NULL, NULL, NULL,
+#endif
+        find_posix_compile, find_posix_exec, find_posix_n_groups,
+        find_pattern_error, find_posix_free,
+    },
+#ifdef FIND_HAVE_PCRE2
+    {
+        "pcre2", "\\^$.[]|()?*+{}",
+        "(", ")", "|",
+        find_pcre2_compile, find_pcre2_exec, find_pcre2_n_groups,
+        find_pcre2_error, find_pcre2_free,
+    },
+#endif
+};
+
+static find_engine _literal_engine = {
+    "literal", "",
+    NULL, NULL, NULL,
+    find_literal_compile, find_literal_exec, find_literal_n_groups,
+    find_literal_error, find_literal_free,
+};
+
+/* The engine selected by `find-regex-engine', POSIX if it isn't available. */
+static find_engine* find_engine_configured() {
+    char *name;
+
+    name = yed_get_var("find-regex-engine");
+    if (name) {
+        for (size_t i = 0; i < sizeof(_engines) / sizeof(_engines[0]); i++) {
+            if (strcmp(_engines[i].name, name) == 0)
+                return &_engines[i];
+        }
+    }
+    return &_engines[0];
+}
+
+/**
+ * COMPILED PATTERN CACHE
+ */
+
+/* Look up a compiled pattern by id. Returns NULL if it has been evicted. */
+static find_compiled* find_compiled_get(int id) {
+    find_compiled **c;
+
+    if (id <= 0)
+        return NULL;
+    array_traverse(_compiled_cache, c) {
+        if ((*c)->id == id)
+            return *c;
+    }
+    return NULL;
+}
+
+static void find_compiled_free(find_compiled *c) {
+    c->engine->free(c->state);
+    free(c->pattern);
+    free(c);
+}
+
+/*
+ * Is the compiled pattern still used, by the current pattern, by the search of
+ * a buffer (warm ones included) or by a project or file search?
+ */
+static int find_compiled_is_used(find_compiled *c) {
+    matchbuffer *mb;
+
+    if (c == _compiled
+    ||  (_project_search.is_active && _project_search.compiled_id == c->id))
+        return 1;
+
+    array_traverse(_matchbuffers, mb) {
+        if (mb->compiled_id == c->id)
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * Make room for one more pattern in a full cache, evicting the least recently
+ * used pattern that no search uses. There may be none.
+ */
+static void find_compiled_evict() {
+    find_compiled *c, *lru;
+    int            i, lru_idx;
+
+    while (array_len(_compiled_cache) >= FIND_COMPILED_CACHE_LEN) {
+        lru = NULL;
+        lru_idx = 0;
+        for (i = 0; i < array_len(_compiled_cache); i++) {
+            c = *(find_compiled**)array_item(_compiled_cache, i);
+            if ((!lru || c->last_used < lru->last_used) && !find_compiled_is_used(c)) {
+                lru = c;
+                lru_idx = i;
+            }
+        }
+        if (!lru)
+            return;
+
+        find_compiled_free(lru);
+        array_delete(_compiled_cache, lru_idx);
+    }
+}
+
+/*
+ * Return the compiled form of `pattern' for `engine', compiling it in place of
+ * the least recently used pattern of the cache that is no longer in use if it
+ * isn't there. On failure, NULL is returned and `status' holds the engine's
+ * error.
+ */
+static find_compiled* find_compiled_get_or_compile(find_engine *engine,
+                                                   const char *pattern,
+                                                   int is_ignore_case,
+                                                   int *status)
+{
+    find_compiled **it, *c;
+    void           *state;
+    long long       start;
+
+    array_traverse(_compiled_cache, it) {
+        c = *it;
+        if (c->engine == engine
+        &&  c->is_ignore_case == is_ignore_case
+        &&  strcmp(c->pattern, pattern) == 0) {
+            c->last_used = ++_compiled_clock;
+            if (_stats.is_enabled)
+                _stats.n_cache_hits++;
+            *status = 0;
+            return c;
+        }
+    }
+
+    start = find_stats_start();
+    *status = engine->compile(pattern, is_ignore_case, &state);
+    if (_stats.is_enabled) {
+        find_stats_stop(start, &_stats.compile_ns);
+        _stats.n_compiles++;
+    }
+    if (*status != 0)
+        return NULL;
+
+    find_compiled_evict();
+
+    c = malloc(sizeof(*c));
+    c->id = _compiled_next_id++;
+    c->engine = engine;
+    c->state = state;
+    c->pattern = strdup(pattern);
+    c->is_ignore_case = is_ignore_case;
+    c->last_used = ++_compiled_clock;
+    array_push(_compiled_cache, c);
+    return c;
+}
+
+static void find_compiled_free_all() {
+    find_compiled **c;
+
+    array_traverse(_compiled_cache, c)
+        find_compiled_free(*c);
+    array_free(_compiled_cache);
+}
+
+/*
+ * A pattern is literal when it contains none of the configured engine's
+ * metacharacters, i.e. it only ever matches its own text.
+ */
+int find_pattern_is_literal(const char *pattern) {
+    return (strpbrk(pattern, find_engine_configured()->metachars) == NULL);
+}
+
+/*
+ * Whether to ignore case searching for `pattern'. Unless the caller asked to
+ * ignore case, find-regex-smartcase decides: it is only when the pattern has
+ * no uppercase letters. Escaped letters, like `\W', aren't counted.
+ */
+static int find_pattern_case(const char *pattern, int is_ignore_case) {
+    if (is_ignore_case || strcmp(yed_get_var("find-regex-smartcase"), "true") != 0)
+        return is_ignore_case;
+
+    for (const char *p = pattern; *p != '\0'; p++) {
+        if (*p == '\\' && p[1] != '\0')
+            p++;
+        else if (*p >= 'A' && *p <= 'Z')
+            return 0;
+    }
+    return 1;
+}
+
+/* The engine that matches `pattern'. */
+static find_engine* find_pattern_engine(const char *pattern, int is_ignore_case) {
+    if (find_pattern_is_literal(pattern)
+    &&  (!is_ignore_case || find_pattern_is_ascii(pattern)))
+        return &_literal_engine;
+    return find_engine_configured();
+}
+
+/*
+ * Compile the current pattern, or reuse its cached compiled form. Returns 0 on
+ * success or an error for `find_pattern_compile_error'.
+ */
+int find_pattern_compile(int is_ignore_case) {
+    char *pattern;
+    int   status;
+
+    pattern = array_data(_pattern);
+    is_ignore_case = find_pattern_case(pattern, is_ignore_case);
+    _engine = find_pattern_engine(pattern, is_ignore_case);
+
+    _compiled = find_compiled_get_or_compile(_engine, pattern, is_ignore_case, &status);
+    return status;
+}
+
+/* Report a status returned by `find_pattern_compile'. */
+void find_pattern_compile_error(int status) {
+    if (_engine)
+        _engine->error(status);
+}
+
+/**
+ * MATCHBUFFER
+ */
+
+static inline matchbuffer* find_matchbuffer_create(yed_buffer *buffer) {
+    matchbuffer mb;
+    mb.buffer = buffer;
+    mb.matches = array_make_with_cap(match, FIND_DEFAULT_ARRAY_LEN);
+    mb.view_matches = array_make(match);
+    mb.view_lo = 1;
+    mb.view_hi = 0;
+    mb.pattern = array_make_with_cap(char, FIND_DEFAULT_ARRAY_LEN);
+    find_array_terminate(&mb.pattern);
+    mb.is_global = 0;
+    mb.scan_lo = 1;
+    mb.scan_hi = 0;
+    mb.range_lo = 1;
+    mb.range_hi = 0;
+    mb.compiled_id = 0;
+    mb.is_ignore_case = 0;
+    mb.is_capped = 0;
+    mb.n_counted = 0;
+    mb.is_warm = 0;
+    mb.scan_us = 0;
+    mb.is_truncated = 0;
+    mb.has_skipped = 0;
+    array_push(_matchbuffers, mb);
+    return array_last(_matchbuffers);
+}
+
+static void find_matchbuffer_free(matchbuffer *mb) {
+    array_free(mb->matches);
+    array_free(mb->view_matches);
+    array_free(mb->pattern);
+}
+
+static inline void find_matchbuffer_drop_view(matchbuffer *mb) {
+    array_clear(mb->view_matches);
+    mb->view_lo = 1;
+    mb->view_hi = 0;
+}
+
+/* The search shown for `buffer', if it has one. */
+static inline matchbuffer* find_matchbuffer_get(yed_buffer *buffer) {
+    matchbuffer *mb;
+    array_traverse(_matchbuffers, mb) {
+        if (mb->buffer == buffer && !mb->is_warm)
+            return mb;
+    }
+    return NULL;
+}
+
+/* The warm search of `buffer' for `pattern', if it has one. */
+static inline matchbuffer* find_matchbuffer_get_warm(yed_buffer *buffer, const char *pattern) {
+    matchbuffer *mb;
+    array_traverse(_matchbuffers, mb) {
+        if (mb->buffer == buffer
+        &&  mb->is_warm
+        &&  strcmp(array_data(mb->pattern), pattern) == 0)
+            return mb;
+    }
+    return NULL;
+}
+
+/*
+ * Throw away what the warm searches of `buffer' have found, e.g. before a
+ * replace edits much of it, rather than keep them up to date through every
+ * edit. They are searched again in idle time.
+ */
+static void find_matchbuffer_reset_warm(yed_buffer *buffer) {
+    matchbuffer *mb;
+    array_traverse(_matchbuffers, mb) {
+        if (mb->buffer == buffer && mb->is_warm) {
+            array_clear(mb->matches);
+            mb->is_capped = 0;
+            mb->n_counted = 0;
+            mb->compiled_id = 0;
+            mb->scan_lo = 1;
+            mb->scan_hi = 0;
+        }
+    }
+}
+
+static inline matchbuffer* find_matchbuffer_get_or_create(yed_buffer *buffer) {
+    matchbuffer *mb = find_matchbuffer_get(buffer);
+    if (!mb)
+        mb = find_matchbuffer_create(buffer);
+    return mb;
+}
+
+static void find_matchbuffer_clear(matchbuffer *mb) {
+    array_clear(mb->matches);
+    find_matchbuffer_drop_view(mb);
+    find_array_replace(&mb->pattern, "");
+    mb->scan_lo = 1;
+    mb->scan_hi = 0;
+    mb->range_lo = 1;
+    mb->range_hi = 0;
+    mb->compiled_id = 0;
+    mb->is_capped = 0;
+    mb->n_counted = 0;
+    mb->scan_us = 0;
+    mb->is_truncated = 0;
+    mb->has_skipped = 0;
+}
+
+static int find_matchbuffer_num_matches(matchbuffer *mb) {
+    if (mb->is_capped)
+        return mb->n_counted;
+    return array_len(mb->matches);
+}
+
+/* The cap from `find-regex-max-matches', or 0 if there is none. */
+static int find_max_matches() {
+    int n;
+
+    n = 0;
+    sscanf(yed_get_var("find-regex-max-matches"), "%d", &n);
+    if (n < 0)
+        n = 0;
+    return n;
+}
+
+/*
+ * Stop storing the buffer's matches once there are more of them than the cap
+ * allows, keeping only their number. `pending' holds matches that have been
+ * found but not yet added to the buffer's, if any.
+ */
+static void find_matchbuffer_check_cap(matchbuffer *mb, array_t *pending) {
+    int cap, n;
+
+    if (mb->is_capped)
+        return;
+
+    cap = find_max_matches();
+    n = array_len(mb->matches);
+    if (pending)
+        n += array_len(*pending);
+    if (cap == 0 || n <= cap)
+        return;
+
+    mb->is_capped = 1;
+    mb->n_counted = n;
+    /* give the memory back rather than just emptying the array */
+    array_free(mb->matches);
+    mb->matches = array_make_with_cap(match, FIND_DEFAULT_ARRAY_LEN);
+    if (pending)
+        array_clear(*pending);
+}
+
+/*
+ * Matches are kept sorted by line and then by start offset. Returns the index
+ * of the first match that doesn't come before `line', `start', or the number
+ * of matches if there is no such match.
+ */
+static int find_matches_lower_bound(array_t *arr, int line, size_t start) {
+    match *matches;
+    int    lo, hi, mid;
+
+    matches = array_data(*arr);
+    lo = 0;
+    hi = array_len(*arr);
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (matches[mid].line < line
+        || (matches[mid].line == line && matches[mid].start < start))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static inline int find_matchbuffer_lower_bound(matchbuffer *mb, int line, size_t start) {
+    return find_matches_lower_bound(&mb->matches, line, start);
+}
+
+/*
+ * Returns the index of the first match that comes after `line', `start', or
+ * the number of matches if there is no such match.
+ */
+static int find_matchbuffer_upper_bound(matchbuffer *mb, int line, size_t start) {
+    match *matches;
+    int    lo, hi, mid;
+
+    matches = array_data(mb->matches);
+    lo = 0;
+    hi = array_len(mb->matches);
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (matches[mid].line < line
+        || (matches[mid].line == line && matches[mid].start <= start))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Is there a match after row and column `r', `c' in the matches found so far? */
+static int find_matchbuffer_has_match_after(matchbuffer *mb, int r, int c) {
+    match *m;
+
+    m = array_last(mb->matches);
+    if (!m)
+        return 0;
+    return (m->line > r || (m->line == r && m->start > c));
+}
+
+/* Is there a match before row and column `r', `c' in the matches found so far? */
+static int find_matchbuffer_has_match_before(matchbuffer *mb, int r, int c) {
+    match *m;
+
+    m = array_item(mb->matches, 0);
+    if (!m)
+        return 0;
+    return (m->line < r || (m->line == r && m->start < c - 1));
+}
+
+static inline void find_matchbuffer_push_match(array_t *matches_out,
+                                               int row,
+                                               regmatch_t *matches)
+{
+    /*
+     * Only the whole match is kept. Replacing with groups matches again to
+     * get them, so they don't take up room for every match.
+     */
+    match m;
+
+    m.line = row;
+    m.start = matches[0].rm_so;
+    m.end = matches[0].rm_eo;
+
+    array_grow_if_needed(*matches_out);
+    array_push(*matches_out, m);
+}
+
+/*
+ * Iterates over every match within the text of a line. Each search resumes
+ * where the last match ended, and only moves one past it when the match was
+ * empty. An empty match right where the last match ended isn't a match of
+ * its own, so patterns like `a*' find each match exactly once and always
+ * make progress. Engines treat an offset after the start of the line as not
+ * being the beginning of it, so `^' only matches once.
+ */
+typedef struct find_line_iter {
+    const char *text;
+    size_t      len;
+    size_t      offset;
+    /* where the last match ended, or -1 before the first */
+    regoff_t    prev_end;
+    /* whether the text is all ASCII, -1 until an engine needs to know */
+    int         is_ascii;
+} find_line_iter;
+
+static inline void find_line_iter_init(find_line_iter *it, const char *text, size_t len) {
+    it->text = text;
+    it->len = len;
+    it->offset = 0;
+    it->prev_end = -1;
+    it->is_ascii = -1;
+}
+
+/* Find the next match into `matches', returning 0 or REG_NOMATCH. */
+static inline int find_line_iter_next(find_line_iter *it,
+                                      find_engine *engine,
+                                      void *state,
+                                      size_t nmatches,
+                                      regmatch_t *matches)
+{
+    /* an empty match at the very end of the line is still a match */
+    while (it->offset <= it->len) {
+        if (engine->exec(state, it->text, it->len, it->offset, nmatches, matches, &it->is_ascii) != 0)
+            return REG_NOMATCH;
+
+        if (matches[0].rm_so == matches[0].rm_eo && matches[0].rm_so == it->prev_end) {
+            it->offset = matches[0].rm_so + 1;
+            continue;
+        }
+
+        it->prev_end = matches[0].rm_eo;
+        it->offset = matches[0].rm_eo;
+        if (matches[0].rm_so == matches[0].rm_eo)
+            it->offset++;
+        return 0;
+    }
+
+    return REG_NOMATCH;
+}
+
+/* Has a key been typed that the editor hasn't read yet? */
+static int find_key_is_pending() {
+    struct pollfd fd;
+
+    fd.fd = STDIN_FILENO;
+    fd.events = POLLIN;
+    fd.revents = 0;
+    return (poll(&fd, 1, 0) > 0);
+}
+
+/*
+ * Has a key been typed at a prompt? Each key there can start a new search, so
+ * a search that is still going on synchronously stops for it, leaving the
+ * rest to the background.
+ */
+static int find_search_is_cancelled() {
+    return (ys->interactive_command && find_key_is_pending());
+}
+
+/*
+ * Should a scan stop where it is, with its time up at `deadline' or a key
+ * typed at a prompt? A deadline of 0 means the scan must finish. Scans check
+ * this between chunks of rows, from every thread.
+ */
+static int find_scan_should_stop(long long deadline) {
+    return (deadline != 0
+            && (find_time_now_us() >= deadline || find_search_is_cancelled()));
+}
+
+/*
+ * Search rows [from, to] of `buffer' with the compiled `state' of `engine',
+ * pushing matches in sorted order onto `matches_out', unless it is NULL.
+ * Lines longer than `max_len', if it isn't 0, are skipped and counted in
+ * `n_skipped'. The scan may stop after any chunk of rows for `deadline', and
+ * `last_row' is set to the last row it searched. Returns the number of
+ * matches found.
+ */
+static int find_scan_rows(yed_buffer *buffer,
+                           find_engine *engine,
+                           void *state,
+                           array_t *matches_out,
+                           int from,
+                           int to,
+                           int is_global,
+                           size_t max_len,
+                           int *n_skipped,
+                           long long deadline,
+                           int *last_row)
+{
+    /* only the whole match is kept, so groups aren't asked for */
+    static const size_t nmatches = 1;
+
+    find_line_iter  it;
+    regmatch_t      match[nmatches];
+    int             row;
+    yed_line       *line;
+    int             n_found;
+
+    n_found = 0;
+    *last_row = to;
+
+    /* search the text of each line of the range where it sits in the buffer */
+    for (row = from; row <= to; row++) {
+        if (row > from
+        &&  (row - from) % FIND_SEARCH_CHUNK_ROWS == 0
+        &&  find_scan_should_stop(deadline)) {
+            *last_row = row - 1;
+            break;
+        }
+
+        line = yed_buff_get_line(buffer, row);
+        if (!line)
+            break;
+
+        /* a bad pattern can take forever on something like a minified line */
+        if (max_len > 0 && array_len(line->chars) > max_len) {
+            (*n_skipped)++;
+            continue;
+        }
+
+        /* find every match within each line */
+        find_line_iter_init(&it, array_data(line->chars), array_len(line->chars));
+        while (find_line_iter_next(&it, engine, state, nmatches, match) == 0) {
+            /* without anywhere to put the match, it is only counted */
+            if (matches_out)
+                find_matchbuffer_push_match(matches_out, row, match);
+            n_found++;
+            if (!is_global)
+                break;
+        }
+    }
+
+    return n_found;
+}
+
+/*
+ * One slice of a parallel scan. Each worker compiles its own copy of the
+ * pattern, since engines keep per-match state in the compiled form, and
+ * collects its matches separately.
+ */
+typedef struct find_scan_job {
+    yed_buffer  *buffer;
+    find_engine *engine;
+    void        *state;
+    int          from;
+    int          to;
+    int          is_global;
+    size_t       max_len;
+    long long    deadline;
+    /* only count the matches of the slice rather than collect them? */
+    int          is_counting;
+    array_t      matches;
+    int          n_found;
+    int          n_skipped;
+    int          last_row;
+    pthread_t    thread;
+    int          is_started;
+} find_scan_job;
+
+static void* find_scan_worker(void *arg) {
+    find_scan_job *job = arg;
+
+    job->n_found = find_scan_rows(job->buffer, job->engine, job->state,
+                                  job->is_counting ? NULL : &job->matches,
+                                  job->from, job->to, job->is_global,
+                                  job->max_len, &job->n_skipped,
+                                  job->deadline, &job->last_row);
+    return NULL;
+}
+
+/* How many threads `find-regex-threads' allows a scan to use. */
+static int find_scan_threads() {
+    int n;
+
+    n = 1;
+    sscanf(yed_get_var("find-regex-threads"), "%d", &n);
+    if (n < 1)
+        n = 1;
+    if (n > FIND_MAX_THREADS)
+        n = FIND_MAX_THREADS;
+    return n;
+}
+
+/* The longest line `find-regex-max-line-length' lets a scan search, 0 for any. */
+static size_t find_max_line_length() {
+    int n;
+
+    n = 0;
+    sscanf(yed_get_var("find-regex-max-line-length"), "%d", &n);
+    return (n > 0) ? n : 0;
+}
+
+/* How long `find-regex-search-budget-ms' lets a search scan, 0 for forever. */
+static int find_search_budget_ms() {
+    int n;
+
+    n = 0;
+    sscanf(yed_get_var("find-regex-search-budget-ms"), "%d", &n);
+    return (n > 0) ? n : 0;
+}
+
+/*
+ * Split rows [from, to] into one contiguous slice per thread and scan them at
+ * the same time. The calling thread takes the first slice with the cached
+ * compiled pattern. Since the slices are in row order, appending their
+ * matches one after another keeps `matches_out' sorted. A slice that stopped
+ * for `deadline' ends what was searched, so the slices after it are thrown
+ * away and `last_row' is its last row. Returns the number of matches found.
+ */
+static int find_scan_rows_parallel(yed_buffer *buffer,
+                                    find_compiled *compiled,
+                                    array_t *matches_out,
+                                    int from,
+                                    int to,
+                                    int is_global,
+                                    size_t max_len,
+                                    int *n_skipped,
+                                    long long deadline,
+                                    int *last_row,
+                                    int n_threads)
+{
+    find_scan_job *jobs, *job;
+    int            per_job;
+    int            n_found;
+    int            is_stopped;
+    int            i;
+
+    n_found = 0;
+    is_stopped = 0;
+    jobs = find_arena_calloc(n_threads, sizeof(*jobs));
+    per_job = (to - from + n_threads) / n_threads;
+
+    for (i = 0; i < n_threads; i++) {
+        job = &jobs[i];
+        job->buffer = buffer;
+        job->engine = compiled->engine;
+        job->from = from + i * per_job;
+        job->to = job->from + per_job - 1;
+        if (job->to > to)
+            job->to = to;
+        job->is_global = is_global;
+        job->max_len = max_len;
+        job->deadline = deadline;
+        job->is_counting = (matches_out == NULL);
+        job->matches = array_make_with_cap(match, FIND_DEFAULT_ARRAY_LEN);
+
+        if (i == 0) {
+            job->state = compiled->state;
+            continue;
+        }
+
+        /* a slice that can't get its own pattern or thread is left for later */
+        if (job->engine->compile(compiled->pattern, compiled->is_ignore_case, &job->state) != 0) {
+            job->state = NULL;
+            continue;
+        }
+        job->is_started = (pthread_create(&job->thread, NULL, find_scan_worker, job) == 0);
+    }
+
+    find_scan_worker(&jobs[0]);
+
+    for (i = 0; i < n_threads; i++) {
+        job = &jobs[i];
+        if (job->is_started) {
+            pthread_join(job->thread, NULL);
+        } else if (i > 0 && !is_stopped) {
+            job->n_found = find_scan_rows(buffer, compiled->engine, compiled->state,
+                                          job->is_counting ? NULL : &job->matches,
+                                          job->from, job->to, is_global,
+                                          max_len, &job->n_skipped,
+                                          deadline, &job->last_row);
+        }
+        if (i > 0 && job->state)
+            job->engine->free(job->state);
+
+        if (!is_stopped) {
+            n_found += job->n_found;
+            *n_skipped += job->n_skipped;
+            *last_row = job->last_row;
+            is_stopped = (job->last_row < job->to);
+            if (matches_out && array_len(job->matches) > 0)
+                array_push_n(*matches_out, array_data(job->matches), array_len(job->matches));
+        }
+        array_free(job->matches);
+    }
+
+    return n_found;
+}
+
+/*
+ * Search rows [from, to] of the buffer, pushing matches in sorted order onto
+ * `matches_out', or only counting them if it is NULL. Large ranges are split
+ * across threads. The search may stop early for `deadline' (see
+ * find_scan_should_stop), and `last_row' is set to the last row searched.
+ * Returns the number of matches found.
+ */
+static int find_matchbuffer_search_rows_until(matchbuffer *mb,
+                                               array_t *matches_out,
+                                               int from,
+                                               int to,
+                                               int is_global,
+                                               long long deadline,
+                                               int *last_row)
+{
+    find_compiled *compiled;
+    long long      start;
+    size_t         max_len;
+    int            n_threads;
+    int            n_found;
+    int            n_skipped;
+
+    *last_row = to;
+    compiled = find_compiled_get(mb->compiled_id);
+    if (!compiled)
+        return 0;
+
+    start = find_stats_start();
+    max_len = find_max_line_length();
+    n_skipped = 0;
+    n_threads = find_scan_threads();
+    if (n_threads > 1 && to - from + 1 >= FIND_PARALLEL_MIN_ROWS)
+        n_found = find_scan_rows_parallel(mb->buffer, compiled, matches_out, from, to, is_global,
+                                          max_len, &n_skipped, deadline, last_row, n_threads);
+    else
+        n_found = find_scan_rows(mb->buffer, compiled->engine, compiled->state, matches_out, from, to, is_global,
+                                 max_len, &n_skipped, deadline, last_row);
+    to = *last_row;
+
+    if (n_skipped > 0 && !mb->has_skipped) {
+        mb->has_skipped = 1;
+        if (!mb->is_warm && !ys->interactive_command)
+            yed_cprint("[FIND] Lines longer than %zu bytes are not searched", max_len);
+    }
+
+    if (_stats.is_enabled) {
+        find_stats_stop(start, &_stats.scan_ns);
+        if (to > yed_buff_n_lines(mb->buffer))
+            to = yed_buff_n_lines(mb->buffer);
+        if (to >= from)
+            _stats.n_lines_scanned += to - from + 1;
+        _stats.n_matches += n_found;
+    }
+    return n_found;
+}
+
+/* Search all of rows [from, to] of the buffer, as above. */
+static int find_matchbuffer_search_rows(matchbuffer *mb,
+                                         array_t *matches_out,
+                                         int from,
+                                         int to,
+                                         int is_global)
+{
+    int last_row;
+
+    return find_matchbuffer_search_rows_until(mb, matches_out, from, to, is_global, 0, &last_row);
+}
+
+/* The rows searched at once, between checks of the cap. */
+static inline int find_scan_piece_rows() {
+    return FIND_PARALLEL_MIN_ROWS * find_scan_threads();
+}
+
+/*
+ * When the buffer's search, which began its current step at `start', runs out
+ * of `find-regex-search-budget-ms'. Without a budget, it only stops for a key
+ * typed at a prompt.
+ */
+static long long find_matchbuffer_deadline(matchbuffer *mb, long long start) {
+    int budget_ms;
+
+    budget_ms = find_search_budget_ms();
+    if (budget_ms == 0)
+        return LLONG_MAX;
+    return start + (long long)budget_ms * 1000 - mb->scan_us;
+}
+
+/*
+ * Search rows [from, to] of the buffer onto `matches_out', one piece at a time
+ * so that the buffer is capped as soon as its matches pass the cap, rather than
+ * after the whole range has been stored. Once capped, the rest of the rows are
+ * only counted. It may stop early for `deadline', after any chunk of rows
+ * past the first (see find_scan_should_stop). Returns the last row searched.
+ */
+static int find_matchbuffer_collect_rows(matchbuffer *mb, array_t *matches_out, int from, int to,
+                                         long long deadline)
+{
+    array_t *pending;
+    int      piece, piece_to;
+    int      last_row;
+
+    pending = (matches_out == &mb->matches) ? NULL : matches_out;
+    piece = find_scan_piece_rows();
+
+    while (from <= to) {
+        piece_to = from + piece - 1;
+        if (piece_to > to)
+            piece_to = to;
+
+        if (mb->is_capped) {
+            mb->n_counted += find_matchbuffer_search_rows_until(mb, NULL, from, piece_to, mb->is_global,
+                                                                deadline, &last_row);
+        } else {
+            find_matchbuffer_search_rows_until(mb, matches_out, from, piece_to, mb->is_global,
+                                               deadline, &last_row);
+            find_matchbuffer_check_cap(mb, pending);
+        }
+        from = last_row + 1;
+
+        if (last_row < piece_to || (from <= to && find_scan_should_stop(deadline)))
+            break;
+    }
+
+    return from - 1;
+}
+
+/* The last row the buffer's search may reach. */
+static inline int find_matchbuffer_range_last(matchbuffer *mb) {
+    int n_lines;
+
+    n_lines = yed_buff_n_lines(mb->buffer);
+    if (mb->range_hi > 0 && mb->range_hi < n_lines)
+        return mb->range_hi;
+    return n_lines;
+}
+
+static inline int find_matchbuffer_search_is_done(matchbuffer *mb) {
+    return (mb->is_truncated
+            || (mb->scan_lo <= mb->range_lo
+                && mb->scan_hi >= find_matchbuffer_range_last(mb)));
+}
+
+/*
+ * Matches can only be found while the buffer's compiled pattern is still
+ * cached. Work left over from a pattern that has since been evicted is stale.
+ */
+static inline int find_matchbuffer_search_is_stale(matchbuffer *mb) {
+    return (find_compiled_get(mb->compiled_id) == NULL);
+}
+
+/*
+ * Grow the searched range of the buffer to cover rows [from, to]. Rows below
+ * the searched range are appended and rows above it are prepended so the
+ * matches stay in sorted order. Rows below stop being searched, after any
+ * chunk of rows, as soon as the search is over its budget; rows above are only
+ * searched a chunk at a time, so they are always searched in one go.
+ */
+static void find_matchbuffer_search_extend(matchbuffer *mb, int from, int to) {
+    array_t   above;
+    long long start;
+    long long deadline;
+    int       last;
+    int       budget_ms;
+
+    if (!mb->buffer || mb->is_truncated || find_matchbuffer_search_is_stale(mb))
+        return;
+
+    start = find_time_now_us();
+    deadline = find_matchbuffer_deadline(mb, start);
+
+    last = find_matchbuffer_range_last(mb);
+    if (from < mb->range_lo)
+        from = mb->range_lo;
+    if (to > last)
+        to = last;
+
+    if (to > mb->scan_hi)
+        mb->scan_hi = find_matchbuffer_collect_rows(mb, &mb->matches, mb->scan_hi + 1, to, deadline);
+
+    if (from < mb->scan_lo && !find_scan_should_stop(deadline)) {
+        if (from < mb->scan_lo - FIND_SEARCH_CHUNK_ROWS)
+            from = mb->scan_lo - FIND_SEARCH_CHUNK_ROWS;
+        above = array_make_with_cap(match, FIND_DEFAULT_ARRAY_LEN);
+        find_matchbuffer_collect_rows(mb, &above, from, mb->scan_lo - 1, 0);
+        if (mb->is_capped) {
+            array_free(above);
+        } else {
+            if (array_len(mb->matches) > 0)
+                array_push_n(above, array_data(mb->matches), array_len(mb->matches));
+            array_free(mb->matches);
+            mb->matches = above;
+        }
+        mb->scan_lo = from;
+    }
+
+    if (mb->view_lo <= mb->view_hi
+    &&  mb->scan_lo <= mb->view_lo
+    &&  mb->scan_hi >= mb->view_hi)
+        find_matchbuffer_drop_view(mb);
+
+    mb->scan_us += find_time_now_us() - start;
+    budget_ms = find_search_budget_ms();
+    if (budget_ms > 0
+    &&  mb->scan_us > (long long)budget_ms * 1000
+    &&  !find_matchbuffer_search_is_done(mb)) {
+        mb->is_truncated = 1;
+        if (!mb->is_warm && !ys->interactive_command)
+            yed_cprint("[FIND] Search stopped after %d ms, only the matches found so far are shown",
+                       budget_ms);
+    }
+}
+
+/*
+ * Search `n_rows' rows outside of the searched range, below it first and then
+ * above it. Returns 0 once there is nothing left to search.
+ */
+static int find_matchbuffer_search_step(matchbuffer *mb, int n_rows) {
+    if (!mb->buffer
+    ||  find_matchbuffer_search_is_stale(mb)
+    ||  find_matchbuffer_search_is_done(mb))
+        return 0;
+
+    if (mb->scan_hi < find_matchbuffer_range_last(mb))
+        find_matchbuffer_search_extend(mb, mb->scan_hi + 1, mb->scan_hi + n_rows);
+    else
+        find_matchbuffer_search_extend(mb, mb->scan_lo - n_rows, mb->scan_lo - 1);
+
+    return 1;
+}
+
+/*
+ * Search whatever part of the buffer has not been searched yet. It goes in
+ * steps big enough for every thread, so a search over its budget stops, and
+ * so does one a key was typed during at a prompt.
+ */
+static void find_matchbuffer_search_finish(matchbuffer *mb) {
+    int n_rows;
+
+    n_rows = find_scan_piece_rows();
+    while (!find_search_is_cancelled() && find_matchbuffer_search_step(mb, n_rows))
+        ;
+}
+
+/*
+ * Make sure the rows currently displayed by `frame' have been searched. Only
+ * those rows are ever searched: rows next to the searched range grow it, and
+ * rows away from it become the buffer's view segment. A capped buffer finds
+ * the matches of each row it draws by itself.
+ */
+static void find_matchbuffer_search_visible(matchbuffer *mb, yed_frame *frame) {
+    int top, bottom, last;
+
+    top = frame->buffer_y_offset + 1;
+    bottom = top + frame->height - 1;
+    last = find_matchbuffer_range_last(mb);
+    if (top < mb->range_lo)
+        top = mb->range_lo;
+    if (bottom > last)
+        bottom = last;
+    if (top > bottom || (top >= mb->scan_lo && bottom <= mb->scan_hi))
+        return;
+
+    if (top <= mb->scan_hi + 1 && bottom >= mb->scan_lo - 1) {
+        find_matchbuffer_search_extend(mb, top, bottom);
+        return;
+    }
+
+    if (mb->is_capped
+    ||  mb->is_truncated
+    ||  find_matchbuffer_search_is_stale(mb)
+    ||  (top >= mb->view_lo && bottom <= mb->view_hi))
+        return;
+
+    array_clear(mb->view_matches);
+    find_matchbuffer_search_rows(mb, &mb->view_matches, top, bottom, mb->is_global);
+    mb->view_lo = top;
+    mb->view_hi = bottom;
+}
+
+/* Search one chunk of the rows that are left. Returns 0 once there are none. */
+static int find_matchbuffer_search_chunk(matchbuffer *mb) {
+    return find_matchbuffer_search_step(mb, FIND_SEARCH_CHUNK_ROWS);
+}
+
+/*
+ * Search only as much of the buffer as is needed to know the nearest match
+ * from row and column `r', `c' in the given direction. When there is none
+ * before the edge of the search range, the search wraps, which needs every
+ * row of it. With a `max_rows' other than 0, at most that many more rows are
+ * searched and the search never wraps, leaving the rest to the background.
+ */
+static void find_matchbuffer_search_wait(matchbuffer *mb, int r, int c, int direction, int max_rows) {
+    int n_rows;
+
+    /* a capped buffer finds the nearest match by itself */
+    n_rows = 0;
+    if (direction > 0) {
+        while (!mb->is_capped && !find_matchbuffer_has_match_after(mb, r, c)) {
+            if (mb->scan_hi >= find_matchbuffer_range_last(mb)
+            ||  mb->is_truncated
+            ||  find_matchbuffer_search_is_stale(mb)
+            ||  (max_rows > 0 && n_rows >= max_rows)
+            ||  find_search_is_cancelled())
+                break;
+            find_matchbuffer_search_extend(mb, mb->scan_hi + 1, mb->scan_hi + FIND_SEARCH_CHUNK_ROWS);
+            n_rows += FIND_SEARCH_CHUNK_ROWS;
+        }
+        if (max_rows == 0 && !mb->is_capped && !find_matchbuffer_has_match_after(mb, r, c))
+            find_matchbuffer_search_finish(mb);
+    } else {
+        while (!mb->is_capped && !find_matchbuffer_has_match_before(mb, r, c)) {
+            if (mb->scan_lo <= mb->range_lo
+            ||  mb->is_truncated
+            ||  find_matchbuffer_search_is_stale(mb)
+            ||  (max_rows > 0 && n_rows >= max_rows)
+            ||  find_search_is_cancelled())
+                break;
+            find_matchbuffer_search_extend(mb, mb->scan_lo - FIND_SEARCH_CHUNK_ROWS, mb->scan_lo - 1);
+            n_rows += FIND_SEARCH_CHUNK_ROWS;
+        }
+        if (max_rows == 0 && !mb->is_capped && !find_matchbuffer_has_match_before(mb, r, c))
+            find_matchbuffer_search_finish(mb);
+    }
+}
+
+/*
+ * Begin a search for the current pattern. Only the rows visible in `frame'
+ * are searched immediately; the rest of the buffer is left for
+ * `find_matchbuffer_search_finish'. Any unfinished work from the previous
+ * pattern is stale at this point and simply dropped.
+ *
+ * When the previous search was for a literal pattern and the new pattern is a
+ * literal extension of it, no line without a previous match can match now, so
+ * only those lines are searched again. Returns the number of matches found so
+ * far.
+ */
+int find_matchbuffer_search_start(matchbuffer *mb, yed_frame *frame, int is_global) {
+    matchbuffer *warm, swap;
+    array_t      narrowed;
+    match       *m;
+    char        *prev, *pattern;
+    int          last_row;
+    int          top, bottom;
+
+    pattern = array_data(_pattern);
+
+    /* a recent history pattern may have been searched for already */
+    if (mb->compiled_id != _compiled->id && is_global) {
+        warm = find_matchbuffer_get_warm(mb->buffer, pattern);
+        if (warm && warm->compiled_id == _compiled->id && warm->is_global) {
+            swap = *mb;
+            *mb = *warm;
+            *warm = swap;
+            mb->is_warm = 0;
+            warm->is_warm = 1;
+        }
+    }
+
+    prev = array_data(mb->pattern);
+
+    /*
+     * Searching again for the same compiled pattern, the matches found so far
+     * are still good since edits keep them up to date.
+     */
+    if (mb->scan_lo <= mb->scan_hi
+    &&  mb->is_global == is_global
+    &&  mb->compiled_id == _compiled->id)
+        return find_matchbuffer_num_matches(mb);
+
+    if (mb->scan_lo <= mb->scan_hi
+    &&  !mb->is_capped
+    &&  !mb->is_truncated
+    &&  mb->is_global == is_global
+    &&  mb->is_ignore_case == _compiled->is_ignore_case
+    &&  prev[0] != '\0'
+    &&  strncmp(prev, pattern, strlen(prev)) == 0
+    &&  find_pattern_is_literal(prev)
+    &&  find_pattern_is_literal(pattern)) {
+        mb->compiled_id = _compiled->id;
+        find_matchbuffer_drop_view(mb);
+        narrowed = array_make_with_cap(match, FIND_DEFAULT_ARRAY_LEN);
+        last_row = 0;
+        array_traverse(mb->matches, m) {
+            if (m->line == last_row)
+                continue;
+            last_row = m->line;
+            find_matchbuffer_search_rows(mb, &narrowed, last_row, last_row, is_global);
+        }
+        array_free(mb->matches);
+        mb->matches = narrowed;
+        /* the searched range is unchanged */
+    } else {
+        mb->compiled_id = _compiled->id;
+        mb->range_lo = 1;
+        mb->range_hi = 0;
+        top = frame->buffer_y_offset + 1;
+        bottom = top + frame->height - 1;
+        if (bottom > yed_buff_n_lines(frame->buffer))
+            bottom = yed_buff_n_lines(frame->buffer);
+
+        array_clear(mb->matches);
+        find_matchbuffer_drop_view(mb);
+        mb->is_capped = 0;
+        mb->n_counted = 0;
+        mb->is_global = is_global;
+        mb->scan_us = 0;
+        mb->is_truncated = 0;
+        mb->has_skipped = 0;
+        mb->scan_lo = top;
+        mb->scan_hi = find_matchbuffer_collect_rows(mb, &mb->matches, top, bottom, 0);
+    }
+
+    find_array_replace(&mb->pattern, pattern);
+    mb->is_global = is_global;
+    mb->is_ignore_case = _compiled->is_ignore_case;
+
+    return find_matchbuffer_num_matches(mb);
+}
+
+/*
+ * Set up a search for the current pattern that is limited to rows [from, to],
+ * without searching anything yet. A `to' of 0 means the end of the buffer.
+ */
+static void find_matchbuffer_search_begin(matchbuffer *mb, int from, int to, int is_global) {
+    /* always clear out any matches on a new search */
+    find_matchbuffer_clear(mb);
+    mb->compiled_id = _compiled->id;
+    mb->is_ignore_case = _compiled->is_ignore_case;
+    find_array_replace(&mb->pattern, array_data(_pattern));
+    mb->is_global = is_global;
+
+    if (from < 1)
+        from = 1;
+    mb->range_lo = from;
+    mb->range_hi = to;
+    mb->scan_lo = from;
+    mb->scan_hi = from - 1;
+}
+
+/*
+ * Search rows [from, to] of the buffer, and only those, right away. A `to' of 0
+ * searches to the end of the buffer. Returns the number of matches.
+ */
+int find_matchbuffer_search_in_range(matchbuffer *mb, int from, int to, int is_global) {
+    find_matchbuffer_search_begin(mb, from, to, is_global);
+    find_matchbuffer_search_finish(mb);
+
+    return find_matchbuffer_num_matches(mb);
+}
+
+int find_matchbuffer_search_in_buffer(matchbuffer *mb, int is_global) {
+    return find_matchbuffer_search_in_range(mb, 1, 0, is_global);
+}
+
+/*
+ * The matches on `row', and how many there are in `n'. A capped buffer
+ * doesn't keep them, so they are found again, and only stay good until the
+ * next call.
+ */
+static match* find_matchbuffer_row_matches(matchbuffer *mb, int row, int *n) {
+    array_t *arr;
+    int      first, last;
+
+    if (mb->is_capped) {
+        array_clear(_row_matches);
+        if (row >= mb->range_lo && row <= find_matchbuffer_range_last(mb))
+            find_matchbuffer_search_rows(mb, &_row_matches, row, row, mb->is_global);
+        *n = array_len(_row_matches);
+        return array_data(_row_matches);
+    }
+
+    /* rows outside of the searched range may be in the view segment */
+    arr = &mb->matches;
+    if ((row < mb->scan_lo || row > mb->scan_hi)
+    &&  row >= mb->view_lo && row <= mb->view_hi)
+        arr = &mb->view_matches;
+
+    first = find_matches_lower_bound(arr, row, 0);
+    last = find_matches_lower_bound(arr, row + 1, 0);
+    *n = last - first;
+    return ((match*)array_data(*arr)) + first;
+}
+
+/*
+ * The nearest match of a capped buffer. Rows are searched one at a time from
+ * `r' in the given direction, wrapping around the search range once.
+ */
+static int find_matchbuffer_cursor_nearest_scan(matchbuffer *mb,
+                                                int r,
+                                                int c,
+                                                int *row,
+                                                int *col,
+                                                int direction)
+{
+    match *m;
+    int    first, n_rows;
+    int    cur, n;
+    int    i, j;
+
+    first = mb->range_lo;
+    n_rows = find_matchbuffer_range_last(mb) - first + 1;
+    if (n_rows <= 0)
+        return 1;
+    if (r < first || r >= first + n_rows)
+        r = first;
+
+    for (i = 0; i <= n_rows; i++) {
+        cur = first + (((r - first + i * direction) % n_rows) + n_rows) % n_rows;
+        m = find_matchbuffer_row_matches(mb, cur, &n);
+        if (n == 0)
+            continue;
+
+        /* on the row of the cursor, only matches past it count until wrapping */
+        if (direction > 0) {
+            for (j = 0; j < n; j++) {
+                if (i > 0 || m[j].start > c)
+                    break;
+            }
+        } else {
+            for (j = n - 1; j >= 0; j--) {
+                if (i > 0 || m[j].start < c - 1)
+                    break;
+            }
+        }
+        if (j < 0 || j >= n)
+            continue;
+
+        if (direction > 0 && (cur < r || i == n_rows))
+            yed_cprint("Search hit bottom, continuing at top");
+        else if (direction < 0 && (cur > r || i == n_rows))
+            yed_cprint("Search hit top, continuing at bottom");
+
+        *row = cur;
+        *col = m[j].start + 1;
+        return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * Given row and column `r', `c', search for nearest match in a particular
+ * direction (up or down the buffer). Sets the position of the match in `row'
+ * and `col', and its position among all matches in `index' if it isn't NULL,
+ * and returns 0 if there are matches. Otherwise, `row' and `col' are not
+ * touched and this returns 1.
+ */
+int find_matchbuffer_cursor_nearest_match(matchbuffer *mb,
+                                          int r,
+                                          int c,
+                                          int *row,
+                                          int *col,
+                                          int *index,
+                                          int direction)
+{
+    match *m;
+    int    i;
+
+    if (find_matchbuffer_num_matches(mb) == 0) {
+        if (find_pattern_exists())
+            find_pattern_bad();
+        return 1;
+    }
+
+    if (mb->is_capped) {
+        if (index)
+            *index = -1;
+        return find_matchbuffer_cursor_nearest_scan(mb, r, c, row, col, direction);
+    }
+
+    /*
+     * This relies on the fact that the array of matches is in sorted order in
+     * terms of row and column because matches are found linearly through the
+     * buffer.
+     */
+
+    if (direction > 0) {
+        i = find_matchbuffer_upper_bound(mb, r, c);
+        if (i < find_matchbuffer_num_matches(mb))
+            goto found;
+        i = 0;
+        yed_cprint("Search hit bottom, continuing at top");
+    }
+    else {
+        i = find_matchbuffer_lower_bound(mb, r, c - 1) - 1;
+        if (i >= 0)
+            goto found;
+        i = find_matchbuffer_num_matches(mb) - 1;
+        yed_cprint("Search hit top, continuing at bottom");
+    }
+
+found:
+    m = array_item(mb->matches, i);
+    if (index)
+        *index = i;
+    *row = m->line;
+    *col = m->start + 1;
+    return 0;
+}
+
+/* Remove the matches on `row', returning the index they were at. */
+static int find_matchbuffer_drop_row(matchbuffer *mb, int row) {
+    int first, last;
+
+    first = find_matchbuffer_lower_bound(mb, row, 0);
+    last = find_matchbuffer_lower_bound(mb, row + 1, 0);
+    while (last > first) {
+        array_delete(mb->matches, first);
+        last--;
+    }
+    return first;
+}
+
+/*
+ * Replace the matches on `row' with those found by searching it again. If the
+ * pattern compiled for the buffer's search is gone, the line can only lose its
+ * matches.
+ */
+static void find_matchbuffer_rematch_row(matchbuffer *mb, int row) {
+    match *m;
+    int    first;
+
+    first = find_matchbuffer_drop_row(mb, row);
+
+    if (mb->is_capped || find_matchbuffer_search_is_stale(mb))
+        return;
+
+    /* an uncapped buffer doesn't otherwise use the row scratch */
+    array_clear(_row_matches);
+    find_matchbuffer_search_rows(mb, &_row_matches, row, row, mb->is_global);
+    array_traverse(_row_matches, m) {
+        array_insert(mb->matches, first, *m);
+        first++;
+    }
+}
+
+/* Move every match from `row' on down by `delta' lines. */
+static void find_matchbuffer_shift_rows(matchbuffer *mb, int row, int delta) {
+    match *m;
+    int    i;
+
+    for (i = find_matchbuffer_lower_bound(mb, row, 0); i < array_len(mb->matches); i++) {
+        m = array_item(mb->matches, i);
+        m->line += delta;
+    }
+}
+
+/*
+ * How many matches row `row' has towards a capped buffer's count. Rows that
+ * haven't been searched yet are counted when they are.
+ */
+static int find_matchbuffer_count_row(matchbuffer *mb, int row) {
+    if (row < mb->scan_lo
+    ||  row > mb->scan_hi
+    ||  find_matchbuffer_search_is_stale(mb))
+        return 0;
+
+    return find_matchbuffer_search_rows(mb, NULL, row, row, mb->is_global);
+}
+
+/*
+ * A capped buffer only keeps a count, so the matches of a line that is about
+ * to change or go away are taken off of it before the edit. Those it has
+ * afterwards are added back once the edit is done.
+ */
+void find_matchbuffer_buffer_pre_mod_handler(yed_event *event) {
+    matchbuffer *mb;
+
+    array_traverse(_matchbuffers, mb) {
+        if (!mb->is_capped
+        ||  mb == _replacing_matchbuffer
+        ||  mb->buffer != event->buffer)
+            continue;
+
+        switch (event->buff_mod_event) {
+            case BUFF_MOD_CLEAR:
+            case BUFF_MOD_ADD_LINE:
+            case BUFF_MOD_INSERT_LINE:
+                break;
+
+            default:
+                mb->n_counted -= find_matchbuffer_count_row(mb, event->row);
+                break;
+        }
+    }
+}
+
+/*
+ * Keep the matches of every frame showing the modified buffer in step with
+ * the edit, searching only the lines that changed.
+ */
+void find_matchbuffer_buffer_mod_handler(yed_event *event) {
+    matchbuffer *mb;
+    int          row;
+
+    row = event->row;
+
+    if (event->buffer == _replace_batch.buffer && !_replace_batch.is_applying)
+        find_replace_batch_clear();
+
+    array_traverse(_matchbuffers, mb) {
+        if (mb->buffer == event->buffer)
+            find_matchbuffer_drop_view(mb);
+
+        if (mb == _replacing_matchbuffer
+        ||  mb->buffer != event->buffer
+        ||  mb->scan_lo > mb->scan_hi)
+            continue;
+
+        switch (event->buff_mod_event) {
+            case BUFF_MOD_CLEAR:
+                find_matchbuffer_clear(mb);
+                break;
+
+            case BUFF_MOD_ADD_LINE:
+            case BUFF_MOD_INSERT_LINE:
+                find_matchbuffer_shift_rows(mb, row, 1);
+                if (row < mb->range_lo)
+                    mb->range_lo++;
+                if (mb->range_hi > 0 && row <= mb->range_hi)
+                    mb->range_hi++;
+                if (row < mb->scan_lo)
+                    mb->scan_lo++;
+                if (row <= mb->scan_hi)
+                    mb->scan_hi++;
+                if (row >= mb->scan_lo && row <= mb->scan_hi)
+                    find_matchbuffer_rematch_row(mb, row);
+                if (mb->is_capped)
+                    mb->n_counted += find_matchbuffer_count_row(mb, row);
+                break;
+
+            case BUFF_MOD_DELETE_LINE:
+                if (row >= mb->scan_lo && row <= mb->scan_hi) {
+                    mb->scan_hi--;
+                    find_matchbuffer_drop_row(mb, row);
+                } else if (row < mb->scan_lo) {
+                    mb->scan_lo--;
+                    mb->scan_hi--;
+                }
+                if (row < mb->range_lo)
+                    mb->range_lo--;
+                if (mb->range_hi > 0 && row <= mb->range_hi)
+                    mb->range_hi--;
+                find_matchbuffer_shift_rows(mb, row + 1, -1);
+                break;
+
+            default:
+                /* the text within the line changed */
+                if (row >= mb->scan_lo && row <= mb->scan_hi)
+                    find_matchbuffer_rematch_row(mb, row);
+                if (mb->is_capped)
+                    mb->n_counted += find_matchbuffer_count_row(mb, row);
+                break;
+        }
+    }
+}
+
+/* Forget the matches of a buffer that is going away. */
+void find_matchbuffer_delete_handler(yed_event *event) {
+    matchbuffer *mb;
+    yed_buffer **buffer;
+    int          i;
+
+    if (_confirm.buffer == event->buffer)
+        _confirm.buffer = NULL;
+    if (_replace_batch.buffer == event->buffer)
+        find_replace_batch_clear();
+
+    i = 0;
+    array_traverse(_project_search.buffers, buffer) {
+        if (*buffer == event->buffer) {
+            /* the last one is partly searched */
+            if (i == array_len(_project_search.buffers) - 1)
+                _project_search.n_buffer_rows = 0;
+            array_delete(_project_search.buffers, i);
+            break;
+        }
+        i++;
+    }
+
+    /* the buffer's warm searches go along with the shown one */
+    for (i = array_len(_matchbuffers) - 1; i >= 0; i--) {
+        mb = array_item(_matchbuffers, i);
+        if (mb->buffer == event->buffer) {
+            find_matchbuffer_free(mb);
+            array_delete(_matchbuffers, i);
+        }
+    }
+}
+
+/**
+ * HIGHLIGHTS
+ */
+
+/*
+ * Patterns highlighted in every frame, each with a style of its own, apart
+ * from the search. They are joined into one pattern, `\(a\)\|\(b\)' and so
+ * on, that finds all of them in a single pass over a line, and the group that
+ * took part in a match tells which pattern it was. The rows are matched as
+ * they are drawn, so there is nothing to keep up to date as the buffer is
+ * edited. Patterns that can't be joined, because of back references, their
+ * case being ignored differently or an engine without alternation, are each
+ * matched in turn instead.
+ */
+typedef struct find_highlight {
+    char        *pattern;
+    char        *style;
+    /* the style, resolved with the search's styles */
+    yed_attrs    attrs;
+    /* the group of the joined pattern that is this one, -1 if it isn't joined */
+    int          group;
+    /* this pattern compiled by itself */
+    find_engine *engine;
+    void        *state;
+} find_highlight;
+
+typedef struct find_highlights {
+    array_t      items;
+    int          is_built;
+    /* the joined pattern, if the patterns could be joined */
+    find_engine *engine;
+    void        *state;
+    int          n_groups;
+} find_highlights;
+
+static find_highlights _highlights;
+
+/* Resolve the style named `name' into `attrs'. Returns 1 if there is none. */
+static int find_highlight_style_attrs(const char *name, yed_attrs *attrs) {
+    if (strcmp(name, "search") == 0)
+        *attrs = yed_active_style_get_search();
+    else if (strcmp(name, "attention") == 0)
+        *attrs = yed_active_style_get_attention();
+    else if (strcmp(name, "associate") == 0)
+        *attrs = yed_active_style_get_associate();
+    else if (strcmp(name, "keyword") == 0)
+        *attrs = yed_active_style_get_code_keyword();
+    else if (strcmp(name, "string") == 0)
+        *attrs = yed_active_style_get_code_string();
+    else if (strcmp(name, "number") == 0)
+        *attrs = yed_active_style_get_code_number();
+    else if (strcmp(name, "comment") == 0)
+        *attrs = yed_active_style_get_code_comment();
+    else
+        return 1;
+    return 0;
+}
+
+static int find_pattern_has_backref(const char *pattern) {
+    for (const char *p = pattern; *p != '\0'; p++) {
+        if (*p == '\\' && p[1] != '\0') {
+            p++;
+            if (*p >= '1' && *p <= '9')
+                return 1;
+        }
+    }
+    return 0;
+}
+
+static void find_highlights_free_states() {
+    find_highlight *h;
+
+    array_traverse(_highlights.items, h) {
+        if (h->state)
+            h->engine->free(h->state);
+        h->state = NULL;
+    }
+    if (_highlights.state)
+        _highlights.engine->free(_highlights.state);
+    _highlights.state = NULL;
+    _highlights.is_built = 0;
+}
+
+/* Compile every pattern by itself, then joined into one if they can be. */
+static void find_highlights_build() {
+    find_highlight *h;
+    find_engine    *engine;
+    array_t         joined;
+    int             is_ignore_case, can_join;
+    int             n_groups;
+
+    find_highlights_free_states();
+    _highlights.is_built = 1;
+
+    engine = find_engine_configured();
+    can_join = (engine->alternation != NULL);
+    is_ignore_case = -1;
+    n_groups = 0;
+
+    joined = array_make_with_cap(char, FIND_DEFAULT_ARRAY_LEN);
+    array_traverse(_highlights.items, h) {
+        h->group = -1;
+        if (is_ignore_case < 0)
+            is_ignore_case = find_pattern_case(h->pattern, 0);
+        h->engine = find_pattern_engine(h->pattern, find_pattern_case(h->pattern, 0));
+        if (h->engine->compile(h->pattern, find_pattern_case(h->pattern, 0), &h->state) != 0) {
+            h->state = NULL;
+            continue;
+        }
+
+        if (find_pattern_case(h->pattern, 0) != is_ignore_case
+        ||  find_pattern_has_backref(h->pattern))
+            can_join = 0;
+        if (!can_join)
+            continue;
+
+        if (n_groups > 0)
+            array_push_n(joined, (char*)engine->alternation, strlen(engine->alternation));
+        array_push_n(joined, (char*)engine->group_open, strlen(engine->group_open));
+        array_push_n(joined, h->pattern, strlen(h->pattern));
+        array_push_n(joined, (char*)engine->group_close, strlen(engine->group_close));
+        h->group = n_groups + 1;
+        n_groups = h->group + h->engine->n_groups(h->state);
+    }
+    find_array_terminate(&joined);
+
+    if (can_join
+    &&  n_groups > 0
+    &&  n_groups < FIND_MAX_HIGHLIGHT_GROUPS
+    &&  engine->compile(array_data(joined), is_ignore_case, &_highlights.state) == 0) {
+        /* a pattern that fools the grouping, like `a\)\(b', isn't trusted */
+        if (engine->n_groups(_highlights.state) == n_groups) {
+            _highlights.engine = engine;
+            _highlights.n_groups = n_groups;
+        } else {
+            engine->free(_highlights.state);
+            _highlights.state = NULL;
+        }
+    } else {
+        _highlights.state = NULL;
+    }
+
+    array_free(joined);
+}
+
+static find_highlight* find_highlights_get(const char *pattern) {
+    find_highlight *h;
+
+    array_traverse(_highlights.items, h) {
+        if (strcmp(h->pattern, pattern) == 0)
+            return h;
+    }
+    return NULL;
+}
+
+static void find_highlights_free() {
+    find_highlight *h;
+
+    find_highlights_free_states();
+    array_traverse(_highlights.items, h) {
+        free(h->pattern);
+        free(h->style);
+    }
+    array_free(_highlights.items);
+}
+
+/*
+ * What highlighting needs besides the matches, resolved by the first line
+ * drawn after each update instead of for every line.
+ */
+typedef struct find_highlight_styles {
+    int       is_valid;
+    int       is_styled;
+    int       is_all_frames;
+    size_t    max_line_len;
+    yed_attrs search;
+    yed_attrs search_cursor;
+} find_highlight_styles;
+
+static find_highlight_styles _highlight_styles;
+
+static find_highlight_styles* find_highlight_styles_get() {
+    find_highlight_styles *styles;
+    find_highlight        *h;
+
+    styles = &_highlight_styles;
+    if (!styles->is_valid) {
+        styles->is_styled     = (ys->active_style != NULL);
+        styles->is_all_frames = (strcmp(yed_get_var("find-regex-search-all-frames"), "true") == 0);
+        styles->max_line_len  = find_max_line_length();
+        styles->search        = yed_active_style_get_search();
+        styles->search_cursor = yed_active_style_get_search_cursor();
+        styles->is_valid      = 1;
+
+        array_traverse(_highlights.items, h)
+            find_highlight_style_attrs(h->style, &h->attrs);
+
+        /* the engine may have been changed */
+        if (!_highlights.is_built
+        ||  (_highlights.state && _highlights.engine != find_engine_configured()))
+            find_highlights_build();
+    }
+    return styles;
+}
+
+/*
+ * Highlight columns [from, to) of a line with `style', or by flipping `raw'
+ * if not styling.
+ */
+static inline void find_highlight_fill(find_highlight_styles *styles,
+                                       yed_attrs *attrs,
+                                       int from,
+                                       int to,
+                                       yed_attrs *style,
+                                       unsigned raw)
+{
+    yed_attrs *attr, *end;
+
+    end = attrs + to;
+    if (styles->is_styled) {
+        for (attr = attrs + from; attr < end; attr++)
+            yed_combine_attrs(attr, style);
+    } else {
+        for (attr = attrs + from; attr < end; attr++)
+            attr->flags ^= raw;
+    }
+}
+
+/* Highlight the matches of `mb' on `row', as `frame' draws it into `line_attrs'. */
+static void find_matchbuffer_highlight_row(find_highlight_styles *styles,
+                                           matchbuffer *mb,
+                                           yed_frame *frame,
+                                           int row,
+                                           array_t line_attrs)
+{
+    match     *m, *end;
+    yed_attrs *attrs;
+    long long  start;
+    int        n, width, cursor;
+    int        from, to;
+
+    start = find_stats_start();
+
+    /* the frame may have scrolled into rows the search hasn't reached yet */
+    if (row < mb->scan_lo || row > mb->scan_hi)
+        find_matchbuffer_search_visible(mb, frame);
+
+    attrs = array_data(line_attrs);
+    width = array_len(line_attrs);
+    cursor = (row == frame->cursor_line) ? frame->cursor_col - 1 : -1;
+
+    /* only visit the matches on this row */
+    m = find_matchbuffer_row_matches(mb, row, &n);
+    end = m + n;
+    while (m < end) {
+        /* matches that touch are filled as one span */
+        from = m->start;
+        to = m->end;
+        for (m++; m < end && m->start == (uint32_t)to; m++)
+            to = m->end;
+
+        if (from >= width)
+            break;
+        if (to > width)
+            to = width;
+
+        /* if cursor is within the span, its cell gets the cursor's style */
+        if (cursor >= from && cursor < to) {
+            find_highlight_fill(styles, attrs, from, cursor, &styles->search, ATTR_INVERSE);
+            find_highlight_fill(styles, attrs, cursor, cursor + 1, &styles->search_cursor, ATTR_INVERSE);
+            find_highlight_fill(styles, attrs, cursor + 1, to, &styles->search, ATTR_INVERSE);
+        } else {
+            find_highlight_fill(styles, attrs, from, to, &styles->search, ATTR_INVERSE);
+        }
+    }
+
+    if (_stats.is_enabled) {
+        find_stats_stop(start, &_stats.highlight_ns);
+        _stats.n_highlights++;
+    }
+}
+
+void find_matchbuffer_highlight_handler(yed_event *event) {
+    find_highlight_styles *styles;
+    matchbuffer           *mb;
+    yed_frame             *frame;
+
+    frame = event->frame;
+    if (!frame || !frame->buffer)
+        return;
+
+    /* if we don't have any matches for this frame's buffer, go next */
+    mb = find_matchbuffer_get(frame->buffer);
+    if (!mb)
+        return;
+
+    /* every frame showing the buffer shares its matches, unless told not to */
+    styles = find_highlight_styles_get();
+    if (frame != ys->active_frame && !styles->is_all_frames)
+        return;
+
+    find_matchbuffer_highlight_row(styles, mb, frame, event->row, event->line_attrs);
+}
+
+/* Fill the match in `groups' of the highlight `h', clipped to `width'. */
+static inline void find_highlights_fill_match(find_highlight_styles *styles,
+                                              find_highlight *h,
+                                              yed_attrs *attrs,
+                                              int width,
+                                              regmatch_t *groups)
+{
+    int to;
+
+    to = groups[0].rm_eo;
+    if (to > width)
+        to = width;
+    if (groups[0].rm_so < to)
+        find_highlight_fill(styles, attrs, groups[0].rm_so, to, &h->attrs, ATTR_UNDERLINE);
+}
+
+/*
+ * Highlight the matches of the highlighted patterns on a row. This runs before
+ * the search's handler, so the search is drawn over them.
+ */
+void find_highlights_handler(yed_event *event) {
+    find_highlight_styles *styles;
+    find_highlight        *h;
+    find_line_iter         it;
+    regmatch_t             groups[FIND_MAX_HIGHLIGHT_GROUPS];
+    yed_attrs             *attrs;
+    yed_frame             *frame;
+    yed_line              *line;
+    int                    width;
+
+    frame = event->frame;
+    if (!frame || !frame->buffer || array_len(_highlights.items) == 0)
+        return;
+
+    styles = find_highlight_styles_get();
+    line = yed_buff_get_line(frame->buffer, event->row);
+    if (!line
+    ||  (styles->max_line_len > 0 && array_len(line->chars) > styles->max_line_len))
+        return;
+
+    attrs = array_data(event->line_attrs);
+    width = array_len(event->line_attrs);
+
+    if (_highlights.state) {
+        find_line_iter_init(&it, array_data(line->chars), array_len(line->chars));
+        while (find_line_iter_next(&it, _highlights.engine, _highlights.state,
+                                   _highlights.n_groups + 1, groups) == 0) {
+            if (groups[0].rm_so >= width)
+                break;
+            array_traverse(_highlights.items, h) {
+                if (h->group >= 0 && groups[h->group].rm_so != -1) {
+                    find_highlights_fill_match(styles, h, attrs, width, groups);
+                    break;
+                }
+            }
+        }
+        return;
+    }
+
+    array_traverse(_highlights.items, h) {
+        if (!h->state)
+            continue;
+        find_line_iter_init(&it, array_data(line->chars), array_len(line->chars));
+        while (find_line_iter_next(&it, h->engine, h->state, 1, groups) == 0) {
+            if (groups[0].rm_so >= width)
+                break;
+            find_highlights_fill_match(styles, h, attrs, width, groups);
+        }
+    }
+}
+
+/**
+ * HISTORY PREFETCH
+ */
+
+/* How many recent history patterns `find-regex-history-prefetch' keeps warm. */
+static int find_history_prefetch() {
+    int n;
+
+    n = 0;
+    sscanf(yed_get_var("find-regex-history-prefetch"), "%d", &n);
+    if (n < 0)
+        n = 0;
+    if (n > FIND_MAX_HISTORY_PREFETCH)
+        n = FIND_MAX_HISTORY_PREFETCH;
+    return n;
+}
+
+/*
+ * Fill `recent' with up to `max' of the most recent distinct patterns of the
+ * search history, returning how many there are.
+ */
+static int find_history_recent(char **recent, int max) {
+    char **entry;
+    int    n, i;
+
+    n = 0;
+    array_rtraverse(_search_hist, entry) {
+        if (n == max)
+            break;
+        for (i = 0; i < n; i++) {
+            if (strcmp(recent[i], *entry) == 0)
+                break;
+        }
+        if (i == n && (*entry)[0] != '\0')
+            recent[n++] = *entry;
+    }
+    return n;
+}
+
+/* Remember a finished interactive search, unless it was also the last one. */
+static void find_history_add(char *pattern) {
+    char **last;
+    char  *entry;
+
+    if (pattern[0] == '\0')
+        return;
+    last = array_last(_search_hist);
+    if (last && strcmp(*last, pattern) == 0)
+        return;
+    entry = strdup(pattern);
+    array_push(_search_hist, entry);
+}
+
+/*
+ * Compile `pattern' for a warm search. The compiled form also stays in the
+ * cache for when the pattern is recalled.
+ */
+static find_compiled* find_history_compile(char *pattern) {
+    int is_ignore_case;
+    int status;
+
+    is_ignore_case = find_pattern_case(pattern, 0);
+    return find_compiled_get_or_compile(find_pattern_engine(pattern, is_ignore_case),
+                                        pattern, is_ignore_case, &status);
+}
+
+/*
+ * Do one piece of the work of keeping the recent history patterns warm for
+ * every searched buffer: drop the warm searches of patterns that fell out of
+ * the history, start those that are missing and search a chunk of one that
+ * isn't done. Returns 0 once there is nothing left to do.
+ */
+static int find_history_warm_step() {
+    char          *recent[FIND_MAX_HISTORY_PREFETCH];
+    matchbuffer   *mb, *warm;
+    find_compiled *compiled;
+    yed_buffer    *buffer;
+    int            n_recent;
+    int            i, j;
+
+    n_recent = find_history_recent(recent, find_history_prefetch());
+
+    for (i = array_len(_matchbuffers) - 1; i >= 0; i--) {
+        warm = array_item(_matchbuffers, i);
+        if (!warm->is_warm)
+            continue;
+        for (j = 0; j < n_recent; j++) {
+            if (strcmp(array_data(warm->pattern), recent[j]) == 0)
+                break;
+        }
+        if (j == n_recent || !find_matchbuffer_get(warm->buffer)) {
+            find_matchbuffer_free(warm);
+            array_delete(_matchbuffers, i);
+        }
+    }
+
+    /* creating matchbuffers moves them, so they are only ever looked up by index */
+    for (i = 0; i < array_len(_matchbuffers); i++) {
+        mb = array_item(_matchbuffers, i);
+        if (mb->is_warm || !mb->buffer)
+            continue;
+        buffer = mb->buffer;
+
+        for (j = 0; j < n_recent; j++) {
+            /* the shown search needs no warming */
+            if (find_compiled_get(mb->compiled_id)
+            &&  strcmp(array_data(mb->pattern), recent[j]) == 0)
+                continue;
+
+            warm = find_matchbuffer_get_warm(buffer, recent[j]);
+            if (warm && find_matchbuffer_search_chunk(warm))
+                return 1;
+            if (warm && !find_matchbuffer_search_is_stale(warm))
+                continue;
+
+            /* a new warm search, or one whose compiled pattern was evicted */
+            compiled = find_history_compile(recent[j]);
+            if (!compiled)
+                continue;
+            if (!warm) {
+                warm = find_matchbuffer_create(buffer);
+                warm->is_warm = 1;
+                find_array_replace(&warm->pattern, recent[j]);
+            }
+            array_clear(warm->matches);
+            warm->is_capped = 0;
+            warm->n_counted = 0;
+            warm->scan_us = 0;
+            warm->is_truncated = 0;
+            warm->has_skipped = 0;
+            warm->is_global = 1;
+            warm->is_ignore_case = compiled->is_ignore_case;
+            warm->compiled_id = compiled->id;
+            warm->range_lo = 1;
+            warm->range_hi = 0;
+            warm->scan_lo = 1;
+            warm->scan_hi = 0;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Build the new text of `row' in `out' from the line's current text, putting
+ * the replacement in place of each of the `n' matches starting at `m'.
+ */
+static void find_replace_build_line(yed_line *line,
+                                    match *m,
+                                    int n,
+                                    find_compiled *compiled,
+                                    replace_template *t,
+                                    array_t *out)
+{
+    regmatch_t  groups[10];
+    char       *text;
+    size_t      len, prev_end;
+    int         g;
+    int         is_ascii;
+
+    text = array_data(line->chars);
+    len = array_len(line->chars);
+    is_ascii = -1;
+
+    array_clear(*out);
+    prev_end = 0;
+    for (int i = 0; i < n; i++, m++) {
+        if (m->start > prev_end)
+            array_push_n(*out, text + prev_end, m->start - prev_end);
+
+        /*
+         * Only the whole match is stored, so its groups are found by
+         * matching again from where it starts, which finds the same match.
+         */
+        groups[0].rm_so = m->start;
+        groups[0].rm_eo = m->end;
+        if (t->max_group > 0) {
+            if (compiled->engine->exec(compiled->state, text, len, m->start, t->max_group + 1, groups,
+                                       &is_ascii) != 0
+            ||  groups[0].rm_so != m->start) {
+                groups[0].rm_so = m->start;
+                groups[0].rm_eo = m->end;
+                for (g = 1; g <= t->max_group; g++)
+                    groups[g].rm_so = groups[g].rm_eo = -1;
+            }
+        }
+        find_replace_template_expand(t, text, groups, out);
+
+        prev_end = m->end;
+    }
+    if (len > prev_end)
+        array_push_n(*out, text + prev_end, len - prev_end);
+    find_array_terminate(out);
+}
+
+/* Add the new text of `row', with the `n' matches at `m' replaced, to the batch. */
+static void find_replace_batch_add_row(yed_buffer *buffer,
+                                       int row,
+                                       match *m,
+                                       int n,
+                                       find_compiled *compiled,
+                                       replace_template *t,
+                                       array_t *text)
+{
+    yed_line  *line;
+    long long  start;
+    size_t     offset;
+
+    line = yed_buff_get_line(buffer, row);
+    if (!line)
+        return;
+
+    start = find_stats_start();
+    find_replace_build_line(line, m, n, compiled, t, text);
+
+    offset = array_len(_replace_batch.text);
+    array_push(_replace_batch.rows, row);
+    array_push(_replace_batch.offsets, offset);
+    array_push_n(_replace_batch.text, array_data(*text), array_len(*text));
+    _replace_batch.n_matches += n;
+    if (_stats.is_enabled)
+        find_stats_stop(start, &_stats.replace_ns);
+}
+
+/*
+ * Set every line of the batch to its new text, all in one undo record, so the
+ * whole replace is undone at once. yed can't set a line's text in one edit, so
+ * each line is cleared and its new text inserted. The buffer's matches are
+ * thrown away after, as the edits don't update them.
+ */
+static void find_replace_batch_commit(yed_frame *frame) {
+    yed_buffer  *buffer;
+    matchbuffer *mb;
+    long long    start;
+    int          i;
+    int          row;
+    char        *text;
+
+    buffer = _replace_batch.buffer;
+    mb = find_matchbuffer_get(buffer);
+    _replacing_matchbuffer = mb;
+    find_matchbuffer_reset_warm(buffer);
+    _replace_batch.is_applying = 1;
+
+    yed_start_undo_record(frame, buffer);
+    for (i = 0; i < array_len(_replace_batch.rows); i++) {
+        start = find_stats_start();
+        row = *(int*)array_item(_replace_batch.rows, i);
+        text = (char*)array_data(_replace_batch.text)
+             + *(size_t*)array_item(_replace_batch.offsets, i);
+
+        yed_line_clear(buffer, row);
+        if (text[0] != '\0')
+            yed_buff_insert_string(buffer, text, row, 1);
+        if (_stats.is_enabled) {
+            find_stats_stop(start, &_stats.replace_ns);
+            _stats.n_lines_replaced++;
+        }
+    }
+    yed_end_undo_record(frame, buffer);
+
+    _replace_batch.is_applying = 0;
+    _replacing_matchbuffer = NULL;
+    if (mb)
+        find_matchbuffer_clear(mb);
+    find_replace_batch_clear();
+}
+
+/*
+ * Show the lines the batch changes in the preview buffer, each one as it is
+ * and then as it will be, like a diff.
+ */
+static void find_replace_batch_preview() {
+    yed_buffer *preview;
+    array_t     out;
+    char        head[128];
+    char       *old, *text;
+    int         i, n_rows;
+    int         row, out_row;
+
+    preview = yed_get_or_create_special_rdonly_buffer(FIND_PREVIEW_BUFFER);
+    preview->flags &= ~BUFF_RD_ONLY;
+    yed_buff_clear_no_undo(preview);
+
+    n_rows = array_len(_replace_batch.rows);
+    snprintf(head, sizeof(head), "%d matches on %d lines of %s",
+             _replace_batch.n_matches, n_rows, _replace_batch.buffer->name);
+    yed_append_text_to_line_no_undo(preview, 1, head);
+
+    out = array_make_with_cap(char, FIND_DEFAULT_ARRAY_LEN);
+    for (i = 0; i < n_rows && i < FIND_PREVIEW_MAX_LINES; i++) {
+        row = *(int*)array_item(_replace_batch.rows, i);
+        text = (char*)array_data(_replace_batch.text)
+             + *(size_t*)array_item(_replace_batch.offsets, i);
+        old = yed_get_line_text(_replace_batch.buffer, row);
+
+        array_clear(out);
+        array_push_n(out, head, snprintf(head, sizeof(head), "-%d: ", row));
+        if (old)
+            array_push_n(out, old, strlen(old));
+        find_array_terminate(&out);
+        out_row = yed_buffer_add_line_no_undo(preview);
+        yed_append_text_to_line_no_undo(preview, out_row, array_data(out));
+
+        array_clear(out);
+        array_push_n(out, head, snprintf(head, sizeof(head), "+%d: ", row));
+        array_push_n(out, text, strlen(text));
+        find_array_terminate(&out);
+        out_row = yed_buffer_add_line_no_undo(preview);
+        yed_append_text_to_line_no_undo(preview, out_row, array_data(out));
+
+        free(old);
+    }
+    if (n_rows > FIND_PREVIEW_MAX_LINES) {
+        snprintf(head, sizeof(head), "... and %d more lines", n_rows - FIND_PREVIEW_MAX_LINES);
+        out_row = yed_buffer_add_line_no_undo(preview);
+        yed_append_text_to_line_no_undo(preview, out_row, head);
+    }
+    array_free(out);
+    preview->flags |= BUFF_RD_ONLY;
+
+    YEXE("buffer", FIND_PREVIEW_BUFFER);
+    yed_cprint("[FIND] %d matches on %d lines, `find-regex-replace-apply' replaces them",
+               _replace_batch.n_matches, n_rows);
+}
+
+/*
+ * Compile the pattern and the replacement of a replace. Returns the compiled
+ * pattern, or NULL if either of them is bad.
+ */
+static find_compiled* find_replace_prepare(replace_properties *rp) {
+    replace_template *t;
+    int               status;
+
+    t = &_replace_template;
+
+    status = find_pattern_compile(rp->is_ignore_case);
+    if (status != 0) {
+        find_pattern_compile_error(status);
+        return NULL;
+    }
+
+    find_replace_template_compile(t, array_data(rp->replacement), rp->is_template);
+    if (t->max_group > _compiled->engine->n_groups(_compiled->state)) {
+        yed_cerr("Replacement refers to group %d, but the pattern has %d",
+                 t->max_group, _compiled->engine->n_groups(_compiled->state));
+        return NULL;
+    }
+
+    return _compiled;
+}
+
+/* The rows [from, to] a replace is limited to, where a `to' of 0 is the end. */
+static void find_replace_range(replace_properties *rp, int *from, int *to) {
+    if (rp->is_all_lines || rp->start_line < 0) {
+        *from = 1;
+        *to = 0;
+    } else if (rp->is_single_line) {
+        *from = rp->start_line;
+        *to = rp->start_line;
+    } else {
+        *from = rp->start_line;
+        *to = rp->end_line;
+    }
+}
+
+/*
+ * Replace every match of the current pattern. Each affected line is rebuilt
+ * once into the batch, before any is changed, then either set in a single
+ * step each, as one undo record, or shown in the preview buffer to be applied
+ * later.
+ */
+void find_matchbuffer_replace(matchbuffer *mb, yed_frame *frame) {
+    replace_properties *rp;
+    replace_template   *t;
+    find_compiled      *compiled;
+    yed_buffer         *buffer;
+    match              *m, *end, *first;
+    array_t             text;
+    int                 num_matches;
+    int                 row, last_row, n;
+    int                 from, to;
+
+    rp = find_replace_properties_get();
+    t = &_replace_template;
+
+    compiled = find_replace_prepare(rp);
+    if (!compiled)
+        return;
+
+    /* only the lines the expression asked for are searched */
+    find_replace_range(rp, &from, &to);
+    num_matches = find_matchbuffer_search_in_range(mb, from, to, rp->is_global);
+    if (mb->is_truncated || !find_matchbuffer_search_is_done(mb)) {
+        yed_cerr("[FIND] The search was stopped before it was done, nothing was replaced");
+        return;
+    }
+    if (num_matches == 0) {
+        find_pattern_bad();
+        return;
+    }
+
+    buffer = mb->buffer;
+    find_replace_batch_clear();
+    _replace_batch.buffer = buffer;
+    text = array_make_with_cap(char, FIND_DEFAULT_ARRAY_LEN);
+
+    /* a capped buffer finds the matches of each row of the range again */
+    if (mb->is_capped) {
+        last_row = find_matchbuffer_range_last(mb);
+        for (row = mb->range_lo; row <= last_row; row++) {
+            first = find_matchbuffer_row_matches(mb, row, &n);
+            if (n > 0)
+                find_replace_batch_add_row(buffer, row, first, n, compiled, t, &text);
+        }
+    } else {
+        m = array_data(mb->matches);
+        end = m + num_matches;
+        while (m < end) {
+            /* the matches of one line are next to each other */
+            first = m;
+            while (m < end && m->line == first->line)
+                m++;
+            find_replace_batch_add_row(buffer, first->line, first, m - first, compiled, t, &text);
+        }
+    }
+    array_free(text);
+
+    if (rp->is_preview)
+        find_replace_batch_preview();
+    else
+        find_replace_batch_commit(frame);
+}
+
+/* Apply the replace waiting in the preview buffer. */
+void find_regex_replace_apply(int n_args, char **args) {
+    int n_matches, n_rows;
+
+    if (!_replace_batch.buffer) {
+        yed_cerr("No replace to apply");
+        return;
+    }
+
+    /* the undo record keeps the cursor of a frame showing the buffer */
+    YEXE("buffer", _replace_batch.buffer->name);
+    if (!ys->active_frame || ys->active_frame->buffer != _replace_batch.buffer)
+        return;
+
+    n_matches = _replace_batch.n_matches;
+    n_rows = array_len(_replace_batch.rows);
+    find_replace_batch_commit(ys->active_frame);
+    yed_cprint("[FIND] Replaced %d matches on %d lines", n_matches, n_rows);
+}
+
+/**
+ * PROJECT SEARCH
+ */
+
+/* One file searched by a worker thread. */
+typedef struct find_file_job {
+    char        *path;
+    size_t       max_len;
+    find_engine *engine;
+    void        *state;
+    /* char* formatted result lines */
+    array_t      hits;
+    int          n_skipped;
+    pthread_t    thread;
+    int          is_started;
+} find_file_job;
+
+static char* find_format_hit(const char *name, int row, int col, const char *text, int len) {
+    char *hit;
+    int   size;
+
+    if (len > FIND_RESULT_TEXT_MAX)
+        len = FIND_RESULT_TEXT_MAX;
+    size = snprintf(NULL, 0, "%s:%d:%d: %.*s", name, row, col, len, text) + 1;
+    hit = malloc(size);
+    snprintf(hit, size, "%s:%d:%d: %.*s", name, row, col, len, text);
+    return hit;
+}
+
+static yed_buffer* find_results_buffer() {
+    return yed_get_or_create_special_rdonly_buffer(FIND_RESULTS_BUFFER);
+}
+
+static void find_results_clear() {
+    yed_buffer *buffer;
+
+    buffer = find_results_buffer();
+    buffer->flags &= ~BUFF_RD_ONLY;
+    yed_buff_clear_no_undo(buffer);
+    buffer->flags |= BUFF_RD_ONLY;
+}
+
+static void find_results_append(const char *text) {
+    yed_buffer *buffer;
+    int         row;
+
+    buffer = find_results_buffer();
+    buffer->flags &= ~BUFF_RD_ONLY;
+    /* a cleared buffer still has its one empty line */
+    row = yed_buff_n_lines(buffer);
+    if (_project_search.n_hits > 0)
+        row = yed_buffer_add_line_no_undo(buffer);
+    yed_append_text_to_line_no_undo(buffer, row, text);
+    buffer->flags |= BUFF_RD_ONLY;
+
+    _project_search.n_hits++;
+}
+
+/*
+ * Scan one memory mapped file, line by line, collecting a hit for each line
+ * that matches. Files that look binary are skipped, and so are lines longer
+ * than `max_len'.
+ */
+static void* find_file_worker(void *arg) {
+    find_file_job *job = arg;
+    regmatch_t     match;
+    struct stat    st;
+    char          *data, *p, *end, *nl;
+    size_t         len;
+    int            fd;
+    int            row;
+    char          *hit;
+
+    fd = open(job->path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return NULL;
+
+    end = data + st.st_size;
+    if (memchr(data, '\0', st.st_size < 4096 ? st.st_size : 4096))
+        goto out;
+
+    row = 1;
+    for (p = data; p < end; p = nl + 1, row++) {
+        nl = memchr(p, '\n', end - p);
+        if (!nl)
+            nl = end;
+        len = nl - p;
+        if (job->max_len > 0 && len > job->max_len) {
+            job->n_skipped++;
+            continue;
+        }
+        if (job->engine->exec(job->state, p, len, 0, 1, &match, NULL) == 0) {
+            hit = find_format_hit(job->path, row, match.rm_so + 1, p, len);
+            array_push(job->hits, hit);
+        }
+    }
+
+out:
+    munmap(data, st.st_size);
+    return NULL;
+}
+
+static void find_project_search_stop() {
+    char **path;
+
+    array_traverse(_project_search.paths, path) {
+        free(*path);
+    }
+    array_clear(_project_search.paths);
+    array_clear(_project_search.buffers);
+    _project_search.n_buffer_rows = 0;
+
+    if (_project_search.file_data)
+        munmap(_project_search.file_data, _project_search.file_size);
+    for (int i = 1; i < _project_search.n_file_states; i++)
+        _project_search.file_engine->free(_project_search.file_states[i]);
+    free(_project_search.file_path);
+    _project_search.file_path = NULL;
+    _project_search.file_data = NULL;
+    _project_search.n_file_states = 0;
+
+    _project_search.is_active = 0;
+}
+
+/*
+ * Search the next chunk of lines of an open buffer, skipping the ones that are
+ * too long. Returns 1 once the whole buffer has been searched.
+ */
+static int find_project_search_buffer(yed_buffer *buffer, find_compiled *compiled) {
+    regmatch_t  match;
+    yed_line   *line;
+    char       *hit;
+    size_t      max_len;
+    int         row, last, n_lines;
+
+    max_len = find_max_line_length();
+    n_lines = yed_buff_n_lines(buffer);
+    row = _project_search.n_buffer_rows + 1;
+    last = row + FIND_SEARCH_CHUNK_ROWS - 1;
+    if (last > n_lines)
+        last = n_lines;
+
+    for (; row <= last; row++) {
+        line = yed_buff_get_line(buffer, row);
+        if (!line)
+            break;
+        if (max_len > 0 && (size_t)array_len(line->chars) > max_len) {
+            _project_search.n_skipped++;
+            continue;
+        }
+        if (compiled->engine->exec(compiled->state, array_data(line->chars),
+                                   array_len(line->chars), 0, 1, &match, NULL) != 0)
+            continue;
+        hit = find_format_hit(buffer->name, row, match.rm_so + 1,
+                              array_data(line->chars), array_len(line->chars));
+        find_results_append(hit);
+        free(hit);
+    }
+
+    _project_search.n_buffer_rows = last;
+    return (last >= n_lines);
+}
+
+/* One slice of the lines of a single file, searched by a worker thread. */
+typedef struct find_slice_hit {
+    /* of the match, from the start of the file */
+    size_t    offset;
+    /* of the line, from the start of the slice */
+    long long line;
+    int       col;
+    size_t    len;
+} find_slice_hit;
+
+typedef struct find_slice_job {
+    const char  *data;
+    /* the slice starts a line and ends just past one */
+    size_t       lo, hi;
+    size_t       max_len;
+    find_engine *engine;
+    void        *state;
+    /* find_slice_hit */
+    array_t      hits;
+    long long    n_lines;
+    int          n_skipped;
+    pthread_t    thread;
+    int          is_started;
+} find_slice_job;
+
+static char* find_format_file_hit(const char *path, long long line, int col, size_t offset,
+                                  const char *text, size_t len) {
+    char *hit;
+    int   size;
+
+    if (len > FIND_RESULT_TEXT_MAX)
+        len = FIND_RESULT_TEXT_MAX;
+    size = snprintf(NULL, 0, "%s:%lld:%d:%zu: %.*s", path, line, col, offset, (int)len, text) + 1;
+    hit = malloc(size);
+    snprintf(hit, size, "%s:%lld:%d:%zu: %.*s", path, line, col, offset, (int)len, text);
+    return hit;
+}
+
+/* Scan the lines of one slice, collecting a hit for each line that matches. */
+static void* find_slice_worker(void *arg) {
+    find_slice_job *job = arg;
+    find_slice_hit  hit;
+    regmatch_t      match;
+    const char     *p, *end, *nl;
+
+    end = job->data + job->hi;
+    for (p = job->data + job->lo; p < end; p = nl + 1, job->n_lines++) {
+        nl = memchr(p, '\n', end - p);
+        if (!nl)
+            nl = end;
+        if (job->max_len && (size_t)(nl - p) > job->max_len) {
+            job->n_skipped++;
+            continue;
+        }
+        if (job->engine->exec(job->state, p, nl - p, 0, 1, &match, NULL) != 0)
+            continue;
+        hit.offset = (p - job->data) + match.rm_so;
+        hit.line   = job->n_lines;
+        hit.col    = match.rm_so + 1;
+        hit.len    = nl - p;
+        array_push(job->hits, hit);
+    }
+
+    return NULL;
+}
+
+/*
+ * Search the next slices of the file of `find-in-file-regex', one per
+ * thread. Each slice is cut at the end of the line it would otherwise split,
+ * so slices only count their own lines, and the line of a hit is only known
+ * once the slices before it have been counted.
+ */
+static void find_file_search_step(find_compiled *compiled) {
+    find_slice_job *jobs, *job;
+    find_slice_hit *hit;
+    const char     *data, *nl;
+    size_t          lo, hi, size, max_len;
+    int             n_jobs, max_matches;
+    int             i;
+    char           *text;
+    char            unlisted[64], skipped[64];
+
+    data = _project_search.file_data;
+    size = _project_search.file_size;
+    max_len = find_max_line_length();
+    max_matches = find_max_matches();
+
+    n_jobs = _project_search.n_file_states;
+    jobs = find_arena_calloc(n_jobs, sizeof(*jobs));
+
+    lo = _project_search.file_offset;
+    for (i = 0; i < n_jobs && lo < size; i++) {
+        hi = lo + FIND_FILE_SLICE_LEN;
+        if (hi >= size) {
+            hi = size;
+        } else {
+            nl = memchr(data + hi - 1, '\n', size - hi + 1);
+            hi = nl ? (size_t)(nl - data) + 1 : size;
+        }
+
+        job = &jobs[i];
+        job->data = data;
+        job->lo = lo;
+        job->hi = hi;
+        job->max_len = max_len;
+        job->engine = compiled->engine;
+        job->state = (i == 0) ? compiled->state : _project_search.file_states[i];
+        job->hits = array_make(find_slice_hit);
+        if (i > 0)
+            job->is_started = (pthread_create(&job->thread, NULL, find_slice_worker, job) == 0);
+        lo = hi;
+    }
+    n_jobs = i;
+
+    if (n_jobs > 0)
+        find_slice_worker(&jobs[0]);
+
+    for (i = 0; i < n_jobs; i++) {
+        job = &jobs[i];
+        if (job->is_started)
+            pthread_join(job->thread, NULL);
+        else if (i > 0)
+            find_slice_worker(job);
+
+        array_traverse(job->hits, hit) {
+            if (max_matches && _project_search.n_hits >= max_matches) {
+                _project_search.n_unlisted++;
+                continue;
+            }
+            text = find_format_file_hit(_project_search.file_path,
+                                        _project_search.file_line + hit->line, hit->col,
+                                        hit->offset, data + hit->offset - (hit->col - 1), hit->len);
+            find_results_append(text);
+            free(text);
+        }
+        array_free(job->hits);
+        _project_search.file_line += job->n_lines;
+        _project_search.n_skipped += job->n_skipped;
+    }
+
+    _project_search.file_offset = lo;
+    if (lo < size)
+        return;
+
+    unlisted[0] = skipped[0] = '\0';
+    if (_project_search.n_unlisted > 0)
+        snprintf(unlisted, sizeof(unlisted), ", only the first %d are listed",
+                 _project_search.n_hits);
+    if (_project_search.n_skipped > 0)
+        snprintf(skipped, sizeof(skipped), ", %d lines too long to search",
+                 _project_search.n_skipped);
+    yed_cprint("[FIND] %d matching lines in %lld lines of %s%s%s",
+               _project_search.n_hits + _project_search.n_unlisted,
+               _project_search.file_line - 1, _project_search.file_path,
+               unlisted, skipped);
+    find_project_search_stop();
+}
+
+/*
+ * Search the next open buffer, or the next batch of files, one per thread,
+ * and append their hits to the results buffer.
+ */
+static void find_project_search_step() {
+    find_compiled  *compiled;
+    find_file_job  *jobs, *job;
+    yed_buffer    **buffer;
+    char          **hit;
+    char            skipped[64];
+    int             n_jobs;
+    int             i;
+
+    compiled = find_compiled_get(_project_search.compiled_id);
+    if (!compiled) {
+        if (_project_search.file_data)
+            yed_cerr("[FIND] The pattern of the search was lost, it stopped at line %lld of %s",
+                     _project_search.file_line, _project_search.file_path);
+        else
+            yed_cerr("[FIND] The pattern of the search was lost, it stopped after %d matching lines",
+                     _project_search.n_hits);
+        find_project_search_stop();
+        return;
+    }
+
+    if (_project_search.file_data) {
+        find_file_search_step(compiled);
+        return;
+    }
+
+    /* a buffer is searched a chunk at a time, like any other search */
+    if (array_len(_project_search.buffers) > 0) {
+        buffer = array_last(_project_search.buffers);
+        if (find_project_search_buffer(*buffer, compiled)) {
+            array_pop(_project_search.buffers);
+            _project_search.n_buffer_rows = 0;
+            _project_search.n_searched++;
+        }
+        goto check_done;
+    }
+
+    n_jobs = find_scan_threads();
+    if (n_jobs > array_len(_project_search.paths))
+        n_jobs = array_len(_project_search.paths);
+    jobs = find_arena_calloc(n_jobs, sizeof(*jobs));
+
+    for (i = 0; i < n_jobs; i++) {
+        job = &jobs[i];
+        job->path = *(char**)array_last(_project_search.paths);
+        array_pop(_project_search.paths);
+        job->max_len = find_max_line_length();
+        job->engine = compiled->engine;
+        job->hits = array_make(char*);
+        if (i == 0) {
+            job->state = compiled->state;
+            continue;
+        }
+        if (job->engine->compile(compiled->pattern, compiled->is_ignore_case, &job->state) != 0) {
+            job->state = NULL;
+            continue;
+        }
+        job->is_started = (pthread_create(&job->thread, NULL, find_file_worker, job) == 0);
+    }
+
+    if (n_jobs > 0)
+        find_file_worker(&jobs[0]);
+
+    for (i = 0; i < n_jobs; i++) {
+        job = &jobs[i];
+        if (job->is_started) {
+            pthread_join(job->thread, NULL);
+        } else if (i > 0) {
+            if (job->state)
+                job->engine->free(job->state);
+            job->state = compiled->state;
+            find_file_worker(job);
+        }
+        if (job->is_started && job->state)
+            job->engine->free(job->state);
+
+        /* results go out in the order the files were taken */
+        array_traverse(job->hits, hit) {
+            find_results_append(*hit);
+            free(*hit);
+        }
+        array_free(job->hits);
+        free(job->path);
+        _project_search.n_skipped += job->n_skipped;
+        _project_search.n_searched++;
+    }
+
+check_done:
+    if (array_len(_project_search.buffers) == 0 && array_len(_project_search.paths) == 0) {
+        _project_search.is_active = 0;
+        skipped[0] = '\0';
+        if (_project_search.n_skipped > 0)
+            snprintf(skipped, sizeof(skipped), ", %d lines too long to search",
+                     _project_search.n_skipped);
+        yed_cprint("[FIND] %d matching lines in %d searched%s",
+                   _project_search.n_hits, _project_search.n_searched, skipped);
+    }
+}
+
+/* Collect the regular files under `dir', skipping hidden entries. */
+static void find_project_collect_paths(const char *dir) {
+    DIR           *d;
+    struct dirent *ent;
+    struct stat    st;
+    char          *path;
+    int            size;
+
+    d = opendir(dir);
+    if (!d)
+        return;
+
+    while ((ent = readdir(d)) != NULL) {
+        if (ent->d_name[0] == '.')
+            continue;
+
+        size = strlen(dir) + strlen(ent->d_name) + 2;
+        path = malloc(size);
+        snprintf(path, size, "%s/%s", dir, ent->d_name);
+
+        if (lstat(path, &st) != 0) {
+            free(path);
+        } else if (S_ISDIR(st.st_mode)) {
+            find_project_collect_paths(path);
+            free(path);
+        } else if (S_ISREG(st.st_mode)) {
+            array_push(_project_search.paths, path);
+        } else {
+            free(path);
+        }
+    }
+
+    closedir(d);
+}
+
+/* Join `args' with spaces, since a pattern may have been split up. */
+static void find_join_args(array_t *arr, int n_args, char **args) {
+    array_clear(*arr);
+    for (int i = 0; i < n_args; i++) {
+        if (i > 0)
+            array_push(*arr, " "[0]);
+        array_push_n(*arr, args[i], strlen(args[i]));
+    }
+    find_array_terminate(arr);
+}
+
+/*
+ * Start a new project search for the pattern in `args', dropping any that is
+ * still running, and show the results buffer in the active frame.
+ */
+static int find_project_search_start(int n_args, char **args) {
+    find_compiled *compiled;
+    find_engine   *engine;
+    array_t        pattern;
+    int            is_ignore_case;
+    int            status;
+
+    if (n_args == 0) {
+        yed_cerr("Expected a pattern");
+        return 1;
+    }
+
+    pattern = array_make_with_cap(char, FIND_DEFAULT_ARRAY_LEN);
+    find_join_args(&pattern, n_args, args);
+
+    is_ignore_case = find_pattern_case(array_data(pattern), 0);
+    engine = find_pattern_engine(array_data(pattern), is_ignore_case);
+    compiled = find_compiled_get_or_compile(engine, array_data(pattern), is_ignore_case, &status);
+    array_free(pattern);
+    if (!compiled) {
+        engine->error(status);
+        return 1;
+    }
+
+    find_project_search_stop();
+    _project_search.is_active = 1;
+    _project_search.compiled_id = compiled->id;
+    _project_search.n_hits = 0;
+    _project_search.n_searched = 0;
+    _project_search.n_unlisted = 0;
+    _project_search.n_skipped = 0;
+
+    find_results_clear();
+    YEXE("buffer", FIND_RESULTS_BUFFER);
+    return 0;
+}
+
+void find_regex_search_all_buffers(int n_args, char **args) {
+    tree_it(yed_buffer_name_t, yed_buffer_ptr_t) it;
+    yed_buffer *buffer, *results;
+
+    if (find_project_search_start(n_args, args) != 0)
+        return;
+
+    results = find_results_buffer();
+    tree_traverse(ys->buffers, it) {
+        buffer = tree_it_val(it);
+        if (buffer != results)
+            array_push(_project_search.buffers, buffer);
+    }
+}
+
+void find_regex_search_files(int n_args, char **args) {
+    const char *dir;
+
+    /* with a single argument, the directory is the current one */
+    dir = ".";
+    if (n_args > 1) {
+        dir = args[0];
+        n_args--;
+        args++;
+    }
+
+    if (find_project_search_start(n_args, args) != 0)
+        return;
+
+    find_project_collect_paths(dir);
+    if (array_len(_project_search.paths) == 0) {
+        _project_search.is_active = 0;
+        yed_cprint("[FIND] No files under %s", dir);
+    }
+}
+
+/*
+ * Search a single, possibly huge, file, memory mapped rather than read into a
+ * buffer, a few slices at a time from the pump.
+ */
+void find_regex_search_file(int n_args, char **args) {
+    find_compiled *compiled;
+    struct stat    st;
+    char          *data;
+    int            fd;
+    int            n_states;
+
+    if (n_args < 2) {
+        yed_cerr("Expected a path and a pattern");
+        return;
+    }
+
+    fd = open(args[0], O_RDONLY);
+    if (fd < 0) {
+        yed_cerr("Couldn't open '%s'", args[0]);
+        return;
+    }
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        yed_cerr("'%s' isn't a regular file", args[0]);
+        close(fd);
+        return;
+    }
+
+    if (find_project_search_start(n_args - 1, args + 1) != 0) {
+        close(fd);
+        return;
+    }
+
+    if (st.st_size == 0) {
+        close(fd);
+        _project_search.is_active = 0;
+        yed_cprint("[FIND] %s is empty", args[0]);
+        return;
+    }
+
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        _project_search.is_active = 0;
+        yed_cerr("Couldn't map '%s'", args[0]);
+        return;
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    compiled = find_compiled_get(_project_search.compiled_id);
+    _project_search.file_path = strdup(args[0]);
+    _project_search.file_data = data;
+    _project_search.file_size = st.st_size;
+    _project_search.file_offset = 0;
+    _project_search.file_line = 1;
+    _project_search.file_engine = compiled->engine;
+
+    /* threads that can't get their own copy of the pattern aren't used */
+    n_states = 1;
+    while (n_states < find_scan_threads()
+    &&     compiled->engine->compile(compiled->pattern, compiled->is_ignore_case,
+                                     &_project_search.file_states[n_states]) == 0) {
+        n_states++;
+    }
+    _project_search.n_file_states = n_states;
+}
+
+/*
+ * Load only the lines around a hit of `find-in-file-regex' into the region
+ * buffer, since the file may be far too large to open, and put the cursor on
+ * the match. `offset' is where the match starts in the file.
+ */
+static void find_region_open(const char *path, long long line, int col, long long offset) {
+    yed_buffer *buffer;
+    char       *data, *start, *end, *hit, *p, *nl;
+    long long   lo, line_start;
+    ssize_t     n;
+    int         fd;
+    int         row, hit_row;
+
+    line_start = offset - (col - 1);
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        yed_cerr("Couldn't open '%s'", path);
+        return;
+    }
+    lo = line_start - FIND_REGION_LEN;
+    if (lo < 0)
+        lo = 0;
+    data = malloc(2 * FIND_REGION_LEN + 1);
+    n = pread(fd, data, 2 * FIND_REGION_LEN, lo);
+    close(fd);
+    if (n <= line_start - lo) {
+        yed_cerr("'%s' is shorter than when it was searched", path);
+        free(data);
+        return;
+    }
+
+    /* only whole lines are shown, unless the hit's own is cut short */
+    hit = data + (line_start - lo);
+    start = data;
+    if (lo > 0) {
+        start = memchr(data, '\n', hit - data);
+        start = start ? start + 1 : hit;
+    }
+    end = data + n;
+    if (n == 2 * FIND_REGION_LEN) {
+        while (end > hit && end[-1] != '\n')
+            end--;
+        if (end == hit)
+            end = data + n;
+    }
+    if (end > start && end[-1] == '\n')
+        end--;
+    *end = '\0';
+
+    buffer = yed_get_or_create_special_rdonly_buffer(FIND_REGION_BUFFER);
+    buffer->flags &= ~BUFF_RD_ONLY;
+    yed_buff_clear_no_undo(buffer);
+    hit_row = 1;
+    row = 1;
+    for (p = start; ; p = nl + 1) {
+        nl = memchr(p, '\n', end - p);
+        if (nl)
+            *nl = '\0';
+        if (p == hit)
+            hit_row = row;
+        yed_append_text_to_line_no_undo(buffer, row, p);
+        if (!nl)
+            break;
+        row = yed_buffer_add_line_no_undo(buffer);
+    }
+    buffer->flags |= BUFF_RD_ONLY;
+    free(data);
+
+    YEXE("buffer", FIND_REGION_BUFFER);
+    if (ys->active_frame && ys->active_frame->buffer == buffer)
+        yed_set_cursor_far_within_frame(ys->active_frame, hit_row, col);
+    yed_cprint("[FIND] Lines %lld to %lld of %s", line - (hit_row - 1),
+               line - hit_row + row, path);
+}
+
+/*
+ * ENTER on a line of the results buffer opens the buffer or file of the hit
+ * with the cursor on the match. Hits of `find-in-file-regex' also have the
+ * byte offset of the match, and load the region around it instead.
+ */
+void find_results_key_handler(yed_event *event) {
+    yed_frame *frame;
+    char      *text, *p;
+    int        row, col;
+    long long  line, offset;
+    int        n;
+
+    frame = ys->active_frame;
+    if (event->key != ENTER
+    ||  ys->interactive_command
+    ||  !frame
+    ||  frame->buffer != find_results_buffer())
+        return;
+
+    text = yed_get_line_text(frame->buffer, frame->cursor_line);
+    if (!text)
+        return;
+
+    /* the name may itself contain colons, so take the first `:row:col:' */
+    n = 0;
+    for (p = strchr(text, ':'); p; p = strchr(p + 1, ':')) {
+        if (sscanf(p, ":%d:%d:%n", &row, &col, &n) == 2 && n > 0)
+            break;
+    }
+
+    if (p && isdigit((unsigned char)p[n])
+    &&  sscanf(p, ":%lld:%d:%lld:", &line, &col, &offset) == 3) {
+        *p = '\0';
+        find_region_open(text, line, col, offset);
+        event->cancel = 1;
+    } else if (p) {
+        *p = '\0';
+        YEXE("buffer", text);
+        if (ys->active_frame && ys->active_frame->buffer != find_results_buffer())
+            yed_set_cursor_far_within_frame(ys->active_frame, row, col);
+        event->cancel = 1;
+    }
+
+    free(text);
+}
+
+/*
+ * Set `find-regex-match-status' to where the cursor of the active frame is
+ * among the matches of its buffer, as "n of N", where n counts the matches
+ * starting at or before the cursor. While the search is still going, N is
+ * followed by a '+', and n is a '?' until every row up to the cursor has been
+ * searched. A capped buffer doesn't know n at all. It's empty when there is
+ * no search. Finding n is a binary search, so this is cheap to do on every
+ * update.
+ */
+static void find_match_status_update() {
+    static char  status[64];
+    matchbuffer *mb;
+    yed_frame   *frame;
+    char        *old;
+    const char  *more;
+    int          n;
+
+    status[0] = '\0';
+    frame = ys->active_frame;
+    mb = (frame && frame->buffer) ? find_matchbuffer_get(frame->buffer) : NULL;
+
+    if (mb
+    &&  mb->scan_lo <= mb->scan_hi
+    &&  !find_matchbuffer_search_is_stale(mb)) {
+        more = find_matchbuffer_search_is_done(mb) ? "" : "+";
+        if (mb->is_truncated || mb->has_skipped)
+            more = " (truncated)";
+        if (mb->is_capped
+        ||  mb->scan_lo > mb->range_lo
+        ||  frame->cursor_line > mb->scan_hi) {
+            snprintf(status, sizeof(status), "? of %d%s",
+                     find_matchbuffer_num_matches(mb), more);
+        } else {
+            n = find_matchbuffer_upper_bound(mb, frame->cursor_line, frame->cursor_col - 1);
+            snprintf(status, sizeof(status), "%d of %d%s",
+                     n, find_matchbuffer_num_matches(mb), more);
+        }
+    }
+
+    old = yed_get_var("find-regex-match-status");
+    if (!old || strcmp(old, status) != 0)
+        yed_set_var("find-regex-match-status", status);
+}
+
+/*
+ * Should background work give the editor back? Besides the time budget, a key
+ * typed at a prompt, where each key can start a new search, comes first.
+ */
+static int find_pump_should_yield(long long deadline) {
+    return (find_time_now_us() >= deadline || find_search_is_cancelled());
+}
+
+/*
+ * Keep searching the buffers whose searches are only partially done, one chunk
+ * at a time, then any search across buffers or files and then the warm
+ * searches of recent history patterns, until the pump's time budget runs out.
+ */
+void find_pump_handler(yed_event *event) {
+    matchbuffer *mb;
+    long long    deadline;
+    int          budget_ms;
+    int          pending;
+
+    _stats.is_enabled = (strcmp(yed_get_var("find-regex-stats-enabled"), "true") == 0);
+
+    budget_ms = 0;
+    sscanf(yed_get_var("find-regex-background-budget-ms"), "%d", &budget_ms);
+    deadline = find_time_now_us() + (long long)budget_ms * 1000;
+
+    do {
+        pending = 0;
+        array_traverse(_matchbuffers, mb) {
+            /* a confirmed replace only ever looks for its next match */
+            if (!mb->is_warm && mb->buffer != _confirm.buffer)
+                pending |= find_matchbuffer_search_chunk(mb);
+        }
+    } while (pending && !find_pump_should_yield(deadline));
+
+    while (_project_search.is_active && !find_pump_should_yield(deadline))
+        find_project_search_step();
+
+    /* recent history patterns only get what time is left over */
+    if (!pending && !_project_search.is_active) {
+        while (find_history_warm_step() && !find_pump_should_yield(deadline))
+            ;
+    }
+
+    find_match_status_update();
+    if (_stats.is_enabled)
+        find_stats_publish();
+
+    /* the styles may change before the next draw */
+    _highlight_styles.is_valid = 0;
+
+    /* the update is over, and so is everything allocated during it */
+    find_arena_reset();
+}
+
+/**
+ * INTERACTIVE SEARCH HANDLERS
+ */
+
+void find_interactive_mode_start(int is_find) {
+    if (is_find) {
+        ys->interactive_command = find_get_command(FIND_IN_BUFFER);
+        ys->cmd_prompt = yed_get_var("find-regex-search-prompt");
+    } else {
+        ys->interactive_command = find_get_command(REPLACE_CURRENT_SEARCH);
+        ys->cmd_prompt = yed_get_var("find-regex-replace-prompt");
+    }
+
+    _search_save_row = ys->active_frame->cursor_line;
+    _search_save_col = ys->active_frame->cursor_col;
+
+    yed_clear_cmd_buff();
+    yed_cmd_line_readline_reset(_search_readline, &_search_hist);
+}
+
+void find_interactive_mode_build_array(array_t *arr, char key) {
+    yed_cmd_line_readline_take_key(_search_readline, key);
+    array_zero_term(ys->cmd_buff);
+    find_array_replace(arr, array_data(ys->cmd_buff));
+}
+
+void find_interactive_mode_cancel() {
+    /* handle canceling a search part-way through */
+    ys->interactive_command = NULL;
+    yed_clear_cmd_buff();
+}
+
+void find_interactive_mode_finish() {
+    /* handle finalizing a search */
+    ys->interactive_command = NULL;
+    yed_clear_cmd_buff();
+}
+
+/**
+ * CONFIRM
+ */
+
+/*
+ * Find the first match at or after `col' of `row' and on the rows after it
+ * up to `last', searching the buffer only as far as that match.
+ */
+static int find_confirm_find(int row, size_t col, int last, match *found) {
+    matchbuffer *mb;
+    match       *m;
+    int          r, n, i;
+
+    mb = _confirm.mb;
+    for (r = row; r <= last; r++) {
+        if (!mb->is_capped && (r < mb->scan_lo || r > mb->scan_hi))
+            find_matchbuffer_search_extend(mb, r, r + FIND_SEARCH_CHUNK_ROWS - 1);
+
+        m = find_matchbuffer_row_matches(mb, r, &n);
+        for (i = 0; i < n; i++) {
+            if (r == _confirm.prev_line
+            &&  m[i].start == m[i].end
+            &&  m[i].start == _confirm.prev_end)
+                continue;
+            if (r > row || m[i].start >= col) {
+                *found = m[i];
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/*
+ * Move on to the next match after `col' of the current match's row, and
+ * return 0 if there is one. Without 'g', only the first match of a line is
+ * replaced, so the search moves on to the next line.
+ */
+static int find_confirm_next(size_t col) {
+    matchbuffer *mb;
+    match        found;
+    int          row;
+
+    mb = _confirm.mb;
+    row = _confirm.current.line;
+    if (!mb->is_global) {
+        row++;
+        col = 0;
+    }
+
+    if (!_confirm.is_wrapped) {
+        if (find_confirm_find(row, col, find_matchbuffer_range_last(mb), &found) == 0)
+            goto found;
+        _confirm.is_wrapped = 1;
+        row = mb->range_lo;
+        col = 0;
+    }
 
-    /* always clear out any matches on a new search */
-    find_matchframe_clear(mf);
+    if (find_confirm_find(row, col, _confirm.start_row, &found) != 0)
+        return 1;
+    if (found.line == _confirm.start_row && found.start >= _confirm.start_col)
+        return 1;
 
-    /* search within each line of the buffer */
-    row = 1;
-    while (1) {
-        line = yed_get_line_text(mf->yed_frame->buffer, row);
-        if (!line)
-            break;
+found:
+    _confirm.current = found;
+    yed_set_cursor_far_within_frame(_confirm.frame, found.line, found.start + 1);
+    return 0;
+}
 
-        /* find every match within each line */
-        len = strlen(line);
-        offset = 0;
-        while (offset < len) {
-            status = regexec(&_regex, line + offset, nmatches, match, flags);
-            if (status != 0)
-                break;
-            offset += find_matchframe_push_match(mf, row, offset, nmatches, match);
-            if (!is_global)
-                break;
-        }
+/* Past the current match, stepping over an empty one so it isn't found again. */
+static size_t find_confirm_skip_col(size_t end) {
+    if (end <= _confirm.current.start)
+        return _confirm.current.start + 1;
+    return end;
+}
 
-        free(line);
-        row++;
+/*
+ * Replace the current match, and return the column just past its replacement.
+ * The edit is made of several modifications of the line, so the buffer's
+ * matches leave them alone, and the line is matched again once it's done.
+ */
+static size_t find_confirm_replace_current() {
+    find_compiled *compiled;
+    matchbuffer   *mb;
+    yed_buffer    *buffer;
+    yed_line      *line;
+    match          m;
+    size_t         old_len, new_len;
+
+    mb = _confirm.mb;
+    compiled = find_compiled_get(mb->compiled_id);
+    buffer = mb->buffer;
+    m = _confirm.current;
+    line = yed_buff_get_line(buffer, m.line);
+    if (!compiled || !line)
+        return find_confirm_skip_col(m.end);
+
+    old_len = array_len(line->chars);
+    find_replace_build_line(line, &m, 1, compiled, &_replace_template, &_confirm.text);
+    new_len = array_len(_confirm.text) - 1;
+
+    /* all the accepted replacements are undone together */
+    if (!_confirm.is_recording) {
+        yed_start_undo_record(_confirm.frame, buffer);
+        _confirm.is_recording = 1;
+    }
+    if (mb->is_capped)
+        mb->n_counted -= find_matchbuffer_count_row(mb, m.line);
+    _replacing_matchbuffer = mb;
+    yed_line_clear(buffer, m.line);
+    if (new_len > 0)
+        yed_buff_insert_string(buffer, array_data(_confirm.text), m.line, 1);
+    _replacing_matchbuffer = NULL;
+    if (m.line >= mb->scan_lo && m.line <= mb->scan_hi)
+        find_matchbuffer_rematch_row(mb, m.line);
+    if (mb->is_capped)
+        mb->n_counted += find_matchbuffer_count_row(mb, m.line);
+    _confirm.n_replaced++;
+
+    /* so did the point where the replace stops, once it has wrapped */
+    if (m.line == _confirm.start_row && m.start < _confirm.start_col) {
+        if (_confirm.start_col < m.end)
+            _confirm.start_col = m.end;
+        _confirm.start_col = _confirm.start_col + new_len - old_len;
     }
 
-    return find_matchframe_num_matches(mf);
+    _confirm.prev_line = m.line;
+    _confirm.prev_end = m.end + new_len - old_len;
+
+    /* text after the match moved along with the difference in length */
+    return find_confirm_skip_col(m.end + new_len - old_len);
+}
+
+static void find_confirm_finish() {
+    if (_confirm.is_recording)
+        yed_end_undo_record(_confirm.frame, _confirm.mb->buffer);
+    find_interactive_mode_finish();
+    find_matchbuffer_clear(_confirm.mb);
+    yed_cprint("Replaced %d of the matches", _confirm.n_replaced);
+    _confirm.buffer = NULL;
+    _confirm.mb = NULL;
 }
 
-void find_matchframe_replace(matchframe *mf) {
+/*
+ * Begin a confirmed replace of the current pattern, asking about the first
+ * match at or after the cursor, or at the start of the range when the cursor
+ * is outside of it.
+ */
+void find_confirm_start(matchbuffer *mb, yed_frame *frame) {
     replace_properties *rp;
-    yed_buffer *buffer;
-    match      *m;
-    char       *replacement;
-    int         replacement_len;
-    int         num_matches;
-	int		    status;
-    int         match_len;
-    int         offset;
-    int         last_line;
+    int                 from, to;
+    int                 row;
+    size_t              col;
 
     rp = find_replace_properties_get();
+    if (!find_replace_prepare(rp))
+        return;
 
-    status = find_pattern_compile(rp->is_ignore_case);
-    if (status != 0) {
-        find_pattern_error(status);
+    find_replace_range(rp, &from, &to);
+    find_matchbuffer_search_begin(mb, from, to, rp->is_global);
+
+    _confirm.buffer = mb->buffer;
+    _confirm.mb = mb;
+    _confirm.frame = frame;
+    _confirm.is_wrapped = 0;
+    _confirm.prev_line = 0;
+    _confirm.n_replaced = 0;
+    _confirm.is_recording = 0;
+
+    row = frame->cursor_line;
+    col = frame->cursor_col - 1;
+    if (row < mb->range_lo || row > find_matchbuffer_range_last(mb)) {
+        row = mb->range_lo;
+        col = 0;
+    }
+    /* the one match of a line is on either side of the cursor */
+    if (!mb->is_global)
+        col = 0;
+    _confirm.start_row = row;
+    _confirm.start_col = col;
+
+    /* as if a match just before the start had been skipped */
+    _confirm.current.line = mb->is_global ? row : row - 1;
+    _confirm.current.start = col;
+    if (find_confirm_next(col) != 0) {
+        _confirm.buffer = NULL;
+        _confirm.mb = NULL;
+        find_matchbuffer_clear(mb);
+        find_pattern_bad();
         return;
     }
 
-    /* TODO: search from start to end line, or specific lines */
-    num_matches = find_matchframe_search_in_buffer(mf, rp->is_global);
-    if (num_matches == 0) {
-        find_pattern_bad();
+    ys->interactive_command = find_get_command(FIND_AND_REPLACE);
+    ys->cmd_prompt = yed_get_var("find-regex-confirm-prompt");
+    yed_clear_cmd_buff();
+}
+
+/*
+ * 'y' replaces the match and 'n' skips it, both moving on to the next one.
+ * 'a' replaces it and every match after it without asking, and 'q' stops.
+ */
+void find_confirm_take_key(int key) {
+    size_t col;
+    int    is_done;
+
+    _confirm.mb = _confirm.buffer ? find_matchbuffer_get(_confirm.buffer) : NULL;
+    if (!_confirm.mb) {
+        find_interactive_mode_cancel();
         return;
     }
 
-    buffer = mf->yed_frame->buffer;
-    replacement = array_data(rp->replacement);
-    replacement_len = array_len(rp->replacement) - 1;
+    switch (key) {
+        case 'y':
+            is_done = find_confirm_next(find_confirm_replace_current());
+            break;
+
+        case 'n':
+            _confirm.prev_line = _confirm.current.line;
+            _confirm.prev_end = _confirm.current.end;
+            is_done = find_confirm_next(find_confirm_skip_col(_confirm.current.end));
+            break;
 
-    last_line = -1;
-    offset = 0;
-    array_traverse(mf->matches, m) {
-        match_len = m->end - m->start;
+        case 'a':
+            do {
+                col = find_confirm_replace_current();
+            } while (find_confirm_next(col) == 0);
+            is_done = 1;
+            break;
 
-        /*
-         * Matches are stored as offsets into the line, but we are deleting and
-         * inserting from that line which moves those offsets. We keep a local
-         * offset for each match in a line to deal with where the replacement
-         * should go versus the match's position.
-         */
-        if (last_line != m->line)
-            offset = 0;
-        last_line = m->line;
-
-        /* delete the match one character at a time */
-        for (unsigned i = m->start; i < m->end; i++)
-            yed_delete_from_line(buffer, m->line, m->start + 1 + offset);
-
-        /* insert replacement one character at a time, in reverse */
-        if (replacement[0] != '\0') {
-            for (int i = replacement_len - 1; i >= 0; i--) {
-                yed_insert_into_line(buffer,
-                        m->line,
-                        m->start + 1 + offset,
-                        G(replacement[i]));
-            }
-            offset += replacement_len - match_len;
-        } else {
-            offset -= match_len;
-        }
+        case 'q':
+        case ESC:
+        case CTRL_C:
+            is_done = 1;
+            break;
+
+        default:
+            return;
     }
 
-    find_matchframe_clear(mf);
+    if (is_done)
+        find_confirm_finish();
 }
 
 /**
- * INTERACTIVE SEARCH HANDLERS
+ * BENCHMARK
  */
 
-void find_interactive_mode_start(int is_find) {
-    if (is_find) {
-        ys->interactive_command = find_get_command(FIND_IN_BUFFER);
-        ys->cmd_prompt = yed_get_var("find-regex-search-prompt");
-    } else {
-        ys->interactive_command = find_get_command(REPLACE_CURRENT_SEARCH);
-        ys->cmd_prompt = yed_get_var("find-regex-replace-prompt");
-    }
+#ifdef FIND_HAVE_BENCH
+/*
+ * `find-regex-bench' runs searches over a buffer of generated log lines and
+ * times them, moving to the nearest match and highlighting a screen of rows
+ * for each, then a global replace. The results are written to
+ * FIND_BENCH_BUFFER, so the effect of changes on these paths can be measured
+ * in the editor with the plugin as it is built. It is only built in with
+ * FIND_HAVE_BENCH (`build.sh --bench').
+ */
+typedef struct find_bench_search {
+    const char *name;
+    const char *pattern;
+    int         is_ignore_case;
+} find_bench_search;
+
+static const find_bench_search _bench_searches[] = {
+    { "literal", "status=503",    0 },
+    { "regex",   "id=[0-9]*42 ",  0 },
+    { "icase",   "error.*took=4", 1 },
+};
 
-    _search_save_row = ys->active_frame->cursor_line;
-    _search_save_col = ys->active_frame->cursor_col;
+static int _bench_n_reported;
 
-    yed_clear_cmd_buff();
-    yed_cmd_line_readline_reset(_search_readline, &_search_hist);
+static inline long long find_bench_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
 }
 
-void find_interactive_mode_build_array(array_t *arr, char key) {
-    yed_cmd_line_readline_take_key(_search_readline, key);
-    array_zero_term(ys->cmd_buff);
-    find_array_replace(arr, array_data(ys->cmd_buff));
+/* Bytes of heap in use, if the C library can tell, otherwise 0. */
+static long long find_bench_heap_used() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    return mallinfo2().uordblks;
+#else
+    return 0;
+#endif
 }
 
-void find_interactive_mode_cancel() {
-    /* handle canceling a search part-way through */
-    ys->interactive_command = NULL;
-    yed_clear_cmd_buff();
+static int find_bench_compare(const void *a, const void *b) {
+    long long x, y;
+
+    x = *(const long long*)a;
+    y = *(const long long*)b;
+    return (x > y) - (x < y);
 }
 
-void find_interactive_mode_finish() {
-    /* handle finalizing a search */
-    ys->interactive_command = NULL;
-    yed_clear_cmd_buff();
+static void find_bench_report(const char *fmt, ...) {
+    yed_buffer *buffer;
+    va_list     args;
+    char        line[256];
+    int         row;
+
+    va_start(args, fmt);
+    vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+
+    buffer = yed_get_or_create_special_rdonly_buffer(FIND_BENCH_BUFFER);
+    buffer->flags &= ~BUFF_RD_ONLY;
+    /* a cleared buffer still has its one empty line */
+    row = 1;
+    if (_bench_n_reported > 0)
+        row = yed_buffer_add_line_no_undo(buffer);
+    yed_append_text_to_line_no_undo(buffer, row, line);
+    buffer->flags |= BUFF_RD_ONLY;
+
+    _bench_n_reported++;
+}
+
+/* Report the percentiles of `n' samples, in nanoseconds, as microseconds. */
+static void find_bench_report_latency(const char *name, long long *samples, int n) {
+    qsort(samples, n, sizeof(*samples), find_bench_compare);
+    find_bench_report("  %-8s %5d runs  p50 %9.2f us  p90 %9.2f us  p99 %9.2f us  max %9.2f us",
+                      name, n,
+                      samples[n / 2] / 1000.0,
+                      samples[n * 9 / 10] / 1000.0,
+                      samples[n * 99 / 100] / 1000.0,
+                      samples[n - 1] / 1000.0);
+}
+
+/* Fill `buffer' with `n_lines' log lines. Returns how many bytes they hold. */
+static long long find_bench_fill(yed_buffer *buffer, int n_lines) {
+    char      line[192];
+    unsigned  seed;
+    long long n_bytes;
+    int       row, len;
+
+    buffer->flags &= ~BUFF_RD_ONLY;
+    yed_buff_clear_no_undo(buffer);
+
+    seed = 1;
+    n_bytes = 0;
+    for (int i = 1; i <= n_lines; i++) {
+        seed = seed * 1103515245 + 12345;
+        len = snprintf(line, sizeof(line),
+                       "2026-10-14 %02d:%02d:%02d %-5s worker-%u request id=%d path=/api/v1/items/%u status=%d took=%ums",
+                       (i / 3600) % 24, (i / 60) % 60, i % 60,
+                       ((seed >> 16) % 50 == 0) ? "ERROR" : "INFO",
+                       (seed >> 4) % 16,
+                       i,
+                       (seed >> 12) % 10000,
+                       ((seed >> 8) % 100 == 0) ? 503 : 200,
+                       (seed >> 20) % 500);
+        row = (i == 1) ? 1 : yed_buffer_add_line_no_undo(buffer);
+        yed_append_text_to_line_no_undo(buffer, row, line);
+        n_bytes += len;
+    }
+
+    return n_bytes;
+}
+
+/* Move to the nearest match from random rows, timing each move. */
+static void find_bench_nearest(matchbuffer *mb, int n_lines, long long *samples) {
+    unsigned  seed;
+    long long start;
+    int       row, col;
+
+    seed = 7;
+    for (int i = 0; i < FIND_BENCH_SAMPLES; i++) {
+        seed = seed * 1103515245 + 12345;
+        start = find_bench_now_ns();
+        find_matchbuffer_cursor_nearest_match(mb, 1 + (seed >> 8) % n_lines, 1,
+                                              &row, &col, NULL, (i & 1) ? 1 : -1);
+        samples[i] = find_bench_now_ns() - start;
+    }
+    find_bench_report_latency("nearest", samples, FIND_BENCH_SAMPLES);
 }
 
+/*
+ * Highlight a frame's worth of rows at random places in the buffer, timing
+ * each screen, as the bench's `frame' scrolls over them.
+ */
+static void find_bench_draw(matchbuffer *mb, yed_frame *frame, int n_lines, long long *samples) {
+    find_highlight_styles *styles;
+    array_t                line_attrs;
+    yed_attrs              attrs;
+    unsigned               seed;
+    long long              start;
+    int                    top, row, width;
+
+    styles = find_highlight_styles_get();
+    memset(&attrs, 0, sizeof(attrs));
+    line_attrs = array_make_with_cap(yed_attrs, FIND_BENCH_FRAME_WIDTH);
+    for (width = 0; width < FIND_BENCH_FRAME_WIDTH; width++)
+        array_push(line_attrs, attrs);
+
+    seed = 11;
+    for (int i = 0; i < FIND_BENCH_SAMPLES; i++) {
+        seed = seed * 1103515245 + 12345;
+        top = 1 + (seed >> 8) % n_lines;
+        frame->buffer_y_offset = top - 1;
+        frame->cursor_line = top;
+        frame->cursor_col = 1;
+
+        start = find_bench_now_ns();
+        for (row = top; row < top + frame->height && row <= n_lines; row++)
+            find_matchbuffer_highlight_row(styles, mb, frame, row, line_attrs);
+        samples[i] = find_bench_now_ns() - start;
+    }
+    find_bench_report_latency("draw", samples, FIND_BENCH_SAMPLES);
+
+    array_free(line_attrs);
+}
+
+void find_regex_bench(int n_args, char **args) {
+    replace_properties *rp;
+    matchbuffer        *mb;
+    yed_buffer         *buffer;
+    yed_frame           frame;
+    yed_event           event;
+    long long          *samples;
+    long long           n_bytes, start, heap;
+    double              ms;
+    char               *saved;
+    int                 n_lines, n, status;
+
+    n_lines = FIND_BENCH_DEFAULT_LINES;
+    if (n_args > 1 || (n_args == 1 && (sscanf(args[0], "%d", &n_lines) != 1 || n_lines < 1))) {
+        yed_cerr("Expected an optional number of lines.");
+        return;
+    }
+
+    /* searching changes the current pattern, so it's put back after */
+    saved = strdup(array_data(_pattern));
+    samples = malloc(sizeof(*samples) * FIND_BENCH_SAMPLES);
+
+    _bench_n_reported = 0;
+    buffer = yed_get_or_create_special_rdonly_buffer(FIND_BENCH_BUFFER);
+    buffer->flags &= ~BUFF_RD_ONLY;
+    yed_buff_clear_no_undo(buffer);
+    buffer->flags |= BUFF_RD_ONLY;
+
+    buffer = yed_get_or_create_special_rdonly_buffer(FIND_BENCH_TEXT_BUFFER);
+    start = find_bench_now_ns();
+    n_bytes = find_bench_fill(buffer, n_lines);
+    ms = (find_bench_now_ns() - start) / 1e6;
+    find_bench_report("%d lines, %.1f MB, engine %s, threads %s, built in %.2f ms",
+                      n_lines, n_bytes / 1e6, find_engine_configured()->name,
+                      yed_get_var("find-regex-threads"), ms);
+
+    /*
+     * The text is drawn and replaced through a frame of its own, which is
+     * handed straight to the functions that draw and replace. It is never
+     * made the editor's active frame, and it is never drawn, so it only needs
+     * what the plugin looks at.
+     */
+    memset(&frame, 0, sizeof(frame));
+    frame.buffer = buffer;
+    frame.height = FIND_BENCH_FRAME_HEIGHT;
+    frame.width = FIND_BENCH_FRAME_WIDTH;
+    frame.cursor_line = 1;
+    frame.cursor_col = 1;
+
+    mb = find_matchbuffer_get_or_create(buffer);
+
+    for (unsigned i = 0; i < sizeof(_bench_searches) / sizeof(_bench_searches[0]); i++) {
+        find_array_replace(&_pattern, (char*)_bench_searches[i].pattern);
+        status = find_pattern_compile(_bench_searches[i].is_ignore_case);
+        if (status != 0) {
+            find_pattern_compile_error(status);
+            continue;
+        }
+
+        heap = find_bench_heap_used();
+        start = find_bench_now_ns();
+        n = find_matchbuffer_search_in_buffer(mb, 1);
+        ms = (find_bench_now_ns() - start) / 1e6;
+        find_bench_report("search %-8s %-16s %8d matches %10.2f ms %8.2f Mlines/s %8.1f MB/s  heap %+lld KB",
+                          _bench_searches[i].name, _bench_searches[i].pattern, n, ms,
+                          n_lines / (ms * 1e3), n_bytes / (ms * 1e3),
+                          (find_bench_heap_used() - heap) / 1024);
+
+        find_bench_nearest(mb, n_lines, samples);
+        find_bench_draw(mb, &frame, n_lines, samples);
+    }
+
+    rp = find_replace_properties_reset();
+    rp->is_global = 1;
+    find_array_replace(&rp->replacement, "status=OK");
+    find_array_replace(&_pattern, "status=200");
+
+    heap = find_bench_heap_used();
+    start = find_bench_now_ns();
+    find_matchbuffer_replace(mb, &frame);
+    ms = (find_bench_now_ns() - start) / 1e6;
+    find_bench_report("replace  s/status=200/status=OK/g %10.2f ms %8.2f Mlines/s  heap %+lld KB",
+                      ms, n_lines / (ms * 1e3), (find_bench_heap_used() - heap) / 1024);
+
+    /* let go of the text and its matches */
+    memset(&event, 0, sizeof(event));
+    event.kind = EVENT_BUFFER_PRE_DELETE;
+    event.buffer = buffer;
+    find_matchbuffer_delete_handler(&event);
+    yed_buff_clear_no_undo(buffer);
+    buffer->flags |= BUFF_RD_ONLY;
+
+    /* the replace's undo record holds all of the text it changed */
+    yed_free_undo_history(&buffer->undo_history);
+    buffer->undo_history = yed_new_undo_history();
+
+    find_array_replace(&_pattern, saved);
+    free(saved);
+    free(samples);
+
+    YEXE("buffer", FIND_BENCH_BUFFER);
+}
+#endif
+
 /**
  * YED BINDINGS
  */
 
 void find_regex_search(int n_args, char **args) {
-    yed_frame  *frame;
-    matchframe *mf;
-    int         key;
-    int         status;
-    int         row, col;
-    int         num_matches;
+    yed_frame   *frame;
+    matchbuffer *mb;
+    int          key;
+    int          status;
+    int          row, col;
+    int          num_matches;
+    int          is_known;
 
     if (!ys->active_frame || !ys->active_frame->buffer)
         return;
     frame = ys->active_frame;
 
-    mf = find_matchframe_get_or_create(frame);
+    mb = find_matchbuffer_get_or_create(frame->buffer);
 
     if (!ys->interactive_command) {
         if (n_args == 0) {
             /* YEXE("find-in-buffer") enters interactive mode */
             find_interactive_mode_start(1);
             find_pattern_clear();
+            find_matchbuffer_clear(mb);
             return;
         }
         /* if a pattern is given immediately, use that */
         find_array_replace(&_pattern, args[0]);
+        find_matchbuffer_clear(mb);
     } else {
         /* on interactive mode, build regex incrementally */
         sscanf(args[0], "%d", &key);
@@ -540,11 +5031,12 @@ void find_regex_search(int n_args, char **args) {
             case CTRL_C:
                 find_interactive_mode_cancel();
                 find_pattern_clear();
-                find_matchframe_clear(mf);
+                find_matchbuffer_clear(mb);
                 goto reset_cursor;
 
             case ENTER:
                 find_interactive_mode_finish();
+                find_history_add(array_data(_pattern));
                 break;
 
             default:
@@ -556,158 +5048,181 @@ void find_regex_search(int n_args, char **args) {
     status = find_pattern_compile(0);
     if (status != 0) {
         if (!ys->interactive_command)
-            find_pattern_error(status);
+            find_pattern_compile_error(status);
         return;
     }
 
-    num_matches = find_matchframe_search_in_buffer(mf, 1);
-    if (num_matches == 0) {
-        if (!ys->interactive_command)
+    num_matches = find_matchbuffer_search_start(mb, frame, 1);
+
+    /*
+     * Only the visible rows are guaranteed to have been searched. Search just
+     * far enough to reach the match the cursor moves to; the rest is left
+     * for the background. While typing, that's at most one more chunk, so a
+     * pattern with no match below the cursor doesn't search the whole buffer
+     * on every key. The cursor then stays put until the match is known.
+     */
+    if (ys->interactive_command) {
+        find_matchbuffer_search_wait(mb, _search_save_row, _search_save_col, 1,
+                                     FIND_SEARCH_CHUNK_ROWS);
+        is_known = (mb->is_capped
+                    || find_matchbuffer_has_match_after(mb, _search_save_row, _search_save_col)
+                    || find_matchbuffer_search_is_done(mb));
+    } else {
+        find_matchbuffer_search_wait(mb, _search_save_row, _search_save_col, 1, 0);
+        is_known = 1;
+    }
+    num_matches = find_matchbuffer_num_matches(mb);
+
+    if (num_matches == 0 || !is_known) {
+        if (num_matches == 0 && !ys->interactive_command)
             find_pattern_bad();
 reset_cursor:
         row = _search_save_row;
         col = _search_save_col;
     } else {
         /* use the saved location of the cursor to find nearest match */
-        find_matchframe_cursor_nearest_match(mf,
+        find_matchbuffer_cursor_nearest_match(mb,
                 _search_save_row, _search_save_col,
                 &row, &col,
+                NULL,
                 1); /* TODO: use a direction when searching backwards */
     }
 
     yed_set_cursor_far_within_frame(frame, row, col);
 }
 
-void find_fill_match_buff(char *buff, int size, char *str, regmatch_t match) {
-    int len = match.rm_eo - match.rm_so;
-    if (len == 0) {
-        buff[0] = '\0';
-        return;
+/*
+ * Take the next field of a sed expression from `*p', up to the next '/' that
+ * isn't escaped, and move `*p' past that '/'. A '/' is written `\/' within a
+ * field; every other escape is kept as it is for the regex or replacement.
+ * Returns the field as a string from the arena, or NULL if it isn't closed.
+ */
+static char* find_sed_field(char **p) {
+    char *start, *end, *field, *out;
+
+    start = *p;
+    for (end = start; *end != '/'; end++) {
+        if (*end == '\0')
+            return NULL;
+        if (end[0] == '\\' && end[1] != '\0')
+            end++;
+    }
+
+    field = find_arena_strndup(start, end - start);
+    for (out = field, start = field; *start != '\0'; start++) {
+        if (start[0] == '\\' && start[1] == '/')
+            start++;
+        *out++ = *start;
     }
-    if (len > size)
-        len = size;
-    strncpy(buff, str + match.rm_so, len);
-    buff[len] = '\0';
+    *out = '\0';
+
+    *p = end + 1;
+    return field;
 }
 
 /*
- * Use regex for parsing a regex
+ * Parse an expression of the form [start,][end][%]s/[search]/[replacement]/[options]
+ * in a single pass, filling in the replace properties. The pattern is only
+ * replaced once the whole expression is known to be good.
  */
-int find_parse_sed_expression(matchframe *mf, char *exp)
+int find_parse_sed_expression(yed_frame *frame, char *exp)
 {
-    /*
-     * Matches into 6 groups:
-     * 0) the entire match
-     * 1) beginning line or % for all lines
-     * 2) end line
-     * 3) find expression
-     * 4) replace expression
-     * 5) search modifiers
-     */
-    static const char *pattern = "([0-9]+|%)?,?([0-9]+)?s\\/(.*)\\/(.*)\\/(\\w+)?";
-    static const size_t nmatches = 6;
-
     replace_properties *rp;
-    regmatch_t match[nmatches];
-    regex_t regex;
-    char buff[256];
-    int status;
+    char               *p;
+    char               *search;
+    char               *replacement;
 
     rp = find_replace_properties_reset();
+    p = exp;
 
-    status = regcomp(&regex, pattern, REG_EXTENDED);
-    if (status != 0) {
-        regerror(status, &regex, buff, 256);
-        yed_cerr("%s", buff);
-        return 1;
-    }
-
-    status = regexec(&regex, exp, nmatches, match, 0);
-    if (status != 0) {
-        yed_cerr("Invalid replace expression!");
-        return 1;
-    }
-
-    /*
-     * If the 1st match is empty then check the 2nd match. If that is empty,
-     * then we're doing a find & replace on the current line, otherwise we're
-     * doing a find and replace on the given line.
-     */
-    find_fill_match_buff(buff, 256, exp, match[1]);
-    if (buff[0] == '\0') {
-        find_fill_match_buff(buff, 256, exp, match[2]);
-        if (buff[0] != '\0')
-            sscanf(buff, "%d", &rp->start_line);
-        else
-            rp->start_line = mf->yed_frame->cursor_line;
-        rp->is_single_line = 1;
-    }
     /*
-     * If the 1st match is '%' then we are searching all lines. Verify that the
-     * 2nd is empty.
+     * '%' searches all lines, `start,end' an inclusive range of lines, a lone
+     * number only that line, and nothing at all the line of the cursor.
      */
-    else if (strcmp(buff, "%") == 0) {
-        find_fill_match_buff(buff, 256, exp, match[2]);
-        if (buff[0] != '\0') {
-            yed_cerr("Expression cannot provide both '\%' and ending line number!");
+    if (*p == '%') {
+        p++;
+        if (*p == ',' || isdigit((unsigned char)*p)) {
+            yed_cerr("Expression cannot provide both '%%' and a line number!");
             return 1;
         }
         rp->is_all_lines = 1;
-    }
-    /*
-     * The 1st match must be a number which is the starting line for the
-     * search.  Verify the 2nd match isn't empty. The 2nd match is the ending
-     * line for the search.
-     */
-    else {
-        sscanf(buff, "%d", &rp->start_line);
-        find_fill_match_buff(buff, 256, exp, match[2]);
-        if (buff[0] != '\0') {
-            yed_cerr("Expression provided starting line number but no ending!");
-            return 1;
+    } else if (isdigit((unsigned char)*p)) {
+        rp->start_line = strtol(p, &p, 10);
+        if (*p == ',') {
+            p++;
+            if (!isdigit((unsigned char)*p)) {
+                yed_cerr("Expression provided starting line number but no ending!");
+                return 1;
+            }
+            rp->end_line = strtol(p, &p, 10);
+        } else {
+            rp->is_single_line = 1;
         }
-        sscanf(buff, "%d", &rp->end_line);
+    } else {
+        rp->start_line = frame->cursor_line;
+        rp->is_single_line = 1;
     }
 
-    /*
-     * If the 3rd match wasn't provided then we need to use the internally
-     * saved pattern (from find-in-buffer). Otherwise, we replace the internal
-     * pattern with the provided one.
-     */
-    find_fill_match_buff(buff, 256, exp, match[3]);
-    if (buff[0] != '\0')
-        find_array_replace(&_pattern, buff);
+    if (p[0] != 's' || p[1] != '/') {
+        yed_cerr("Invalid replace expression!");
+        return 1;
+    }
+    p += 2;
 
-    /*
-     * If the 4th pattern wasn't provided, then we will replace with nothing,
-     * or remove the matches found from the buffer.
-     */
-    find_fill_match_buff(buff, 256, exp, match[4]);
-    array_push_n(rp->replacement, buff, (match[4].rm_eo - match[4].rm_so) + 1);
+    search = find_sed_field(&p);
+    replacement = search ? find_sed_field(&p) : NULL;
+    if (!replacement) {
+        yed_cerr("Invalid replace expression!");
+        return 1;
+    }
 
     /*
-     * If the 5th match exists, then we need to match specific search options.
      * 'g' -> replace every match in the line
      * 'c' -> confirm the replacement before changing int
      * 'i' -> ignore case
+     * 'p' -> preview every replacement before changing any
      */
-    find_fill_match_buff(buff, 256, exp, match[5]);
-    if (buff[0] != '\0') {
-        if (strchr(buff, 'g') != NULL)
-            rp->is_global = 1;
-        if (strchr(buff, 'c') != NULL)
-            rp->is_confirm = 1;
-        if (strchr(buff, 'i') != NULL)
-            rp->is_ignore_case = 1;
+    for (; *p != '\0'; p++) {
+        switch (*p) {
+            case 'g': rp->is_global = 1;      break;
+            case 'c': rp->is_confirm = 1;     break;
+            case 'i': rp->is_ignore_case = 1; break;
+            case 'p': rp->is_preview = 1;     break;
+            default:
+                yed_cerr("Unknown replace option '%c'!", *p);
+                return 1;
+        }
+    }
+    if (rp->is_confirm && rp->is_preview) {
+        yed_cerr("Options 'c' and 'p' can't be used together!");
+        return 1;
     }
 
+    /*
+     * Without a search expression, the internally saved pattern (from
+     * find-in-buffer) is used. Without a replacement, the matches are
+     * replaced with nothing, i.e. removed from the buffer.
+     */
+    if (search[0] != '\0')
+        find_array_replace(&_pattern, search);
+    array_push_n(rp->replacement, replacement, strlen(replacement) + 1);
+    rp->is_template = 1;
+
     return 0;
 }
 
 /* So a find & replace using a sed expression */
 void find_regex_sed_replace(int n_args, char **args) {
-    yed_frame  *frame;
-    matchframe *mf;
+    yed_frame   *frame;
+    matchbuffer *mb;
+    int          key;
+
+    /* the only interactive part is confirming each replacement */
+    if (ys->interactive_command) {
+        sscanf(args[0], "%d", &key);
+        find_confirm_take_key(key);
+        return;
+    }
 
     if (n_args == 0 || n_args > 1) {
         yed_cerr("Expected 1 argument, received %d", n_args);
@@ -717,18 +5232,21 @@ void find_regex_sed_replace(int n_args, char **args) {
         return;
     frame = ys->active_frame;
 
-    mf = find_matchframe_get_or_create(frame);
-    if (find_parse_sed_expression(mf, args[0]) != 0)
+    mb = find_matchbuffer_get_or_create(frame->buffer);
+    if (find_parse_sed_expression(frame, args[0]) != 0)
         return;
 
-    find_matchframe_replace(mf);
+    if (find_replace_properties_get()->is_confirm)
+        find_confirm_start(mb, frame);
+    else
+        find_matchbuffer_replace(mb, frame);
 }
 
 /* Replace the current matches in the buffer with the given string */
 void find_regex_replace(int n_args, char **args) {
     replace_properties *rp;
     yed_frame          *frame;
-    matchframe         *mf;
+    matchbuffer        *mb;
     int                 key;
 
     if (!find_pattern_exists()) {
@@ -740,7 +5258,7 @@ void find_regex_replace(int n_args, char **args) {
         return;
     frame = ys->active_frame;
 
-    mf = find_matchframe_get_or_create(frame);
+    mb = find_matchbuffer_get_or_create(frame->buffer);
     rp = find_replace_properties_get();
 
     if (!ys->interactive_command) {
@@ -777,14 +5295,16 @@ void find_regex_replace(int n_args, char **args) {
      * the replacement is done.
      */
 replace:
-    find_matchframe_replace(mf);
+    find_matchbuffer_replace(mb, frame);
 }
 
 void find_cursor_nearest_match(int n_args, char **args, int direction) {
-    int row, col;
-    int r, c;
-    yed_frame  *frame;
-    matchframe *mf;
+    int          row, col;
+    int          r, c;
+    int          i;
+    int          wrapped;
+    yed_frame   *frame;
+    matchbuffer *mb;
 
     if (n_args > 0) {
         yed_cerr("Expected zero arguments.");
@@ -795,15 +5315,30 @@ void find_cursor_nearest_match(int n_args, char **args, int direction) {
         return;
     frame = ys->active_frame;
 
-    mf = find_matchframe_get(frame);
-    if (!mf)
+    mb = find_matchbuffer_get(frame->buffer);
+    if (!mb)
         return;
 
     r = frame->cursor_line;
     c = frame->cursor_col;
 
-    if (find_matchframe_cursor_nearest_match(mf, r, c, &row, &col, direction) == 0)
-        yed_set_cursor_far_within_frame(frame, row, col);
+    find_matchbuffer_search_wait(mb, r, c, direction, 0);
+
+    if (find_matchbuffer_cursor_nearest_match(mb, r, c, &row, &col, &i, direction) != 0)
+        return;
+
+    yed_set_cursor_far_within_frame(frame, row, col);
+
+    /*
+     * The position is only meaningful once every row has been searched, and
+     * it shouldn't hide the notice that the search wrapped around. A capped
+     * buffer doesn't know it at all.
+     */
+    wrapped = (direction > 0)
+                ? (row < r || (row == r && col <= c))
+                : (row > r || (row == r && col >= c));
+    if (find_matchbuffer_search_is_done(mb) && !wrapped && i >= 0)
+        yed_cprint("Match %d of %d", i + 1, find_matchbuffer_num_matches(mb));
 }
 
 void find_cursor_next_match(int n_args, char **args) {
@@ -814,18 +5349,157 @@ void find_cursor_prev_match(int n_args, char **args) {
     find_cursor_nearest_match(n_args, args, -1);
 }
 
+/*
+ * Highlight a pattern with a style, or change the style of one that already
+ * is highlighted.
+ */
+void find_regex_highlight(int n_args, char **args) {
+    find_highlight  h, *existing;
+    find_engine    *engine;
+    yed_attrs       attrs;
+    array_t         pattern;
+    void           *state;
+    int             status;
+
+    if (n_args < 2) {
+        yed_cerr("Expected a style and a pattern");
+        return;
+    }
+
+    if (find_highlight_style_attrs(args[0], &attrs) != 0) {
+        yed_cerr("Unknown style '%s', expected search, attention, associate, keyword, string, number or comment",
+                 args[0]);
+        return;
+    }
+
+    pattern = array_make_with_cap(char, FIND_DEFAULT_ARRAY_LEN);
+    find_join_args(&pattern, n_args - 1, args + 1);
+
+    existing = find_highlights_get(array_data(pattern));
+    if (existing) {
+        free(existing->style);
+        existing->style = strdup(args[0]);
+        array_free(pattern);
+        _highlight_styles.is_valid = 0;
+        return;
+    }
+
+    if (array_len(_highlights.items) >= FIND_MAX_HIGHLIGHTS) {
+        yed_cerr("At most %d patterns can be highlighted", FIND_MAX_HIGHLIGHTS);
+        array_free(pattern);
+        return;
+    }
+
+    /* reject a bad pattern now, rather than leave it out of every draw */
+    engine = find_engine_configured();
+    status = engine->compile(array_data(pattern), 0, &state);
+    if (status != 0) {
+        engine->error(status);
+        array_free(pattern);
+        return;
+    }
+    engine->free(state);
+
+    memset(&h, 0, sizeof(h));
+    h.pattern = strdup(array_data(pattern));
+    h.style = strdup(args[0]);
+    array_free(pattern);
+
+    find_highlights_free_states();
+    array_push(_highlights.items, h);
+    _highlight_styles.is_valid = 0;
+}
+
+/* Stop highlighting a pattern, or every pattern if none is given. */
+void find_regex_unhighlight(int n_args, char **args) {
+    find_highlight *h;
+    array_t         pattern;
+    int             i;
+
+    find_highlights_free_states();
+    _highlight_styles.is_valid = 0;
+
+    if (n_args == 0) {
+        array_traverse(_highlights.items, h) {
+            free(h->pattern);
+            free(h->style);
+        }
+        array_clear(_highlights.items);
+        return;
+    }
+
+    pattern = array_make_with_cap(char, FIND_DEFAULT_ARRAY_LEN);
+    find_join_args(&pattern, n_args, args);
+
+    i = 0;
+    array_traverse(_highlights.items, h) {
+        if (strcmp(h->pattern, array_data(pattern)) == 0) {
+            free(h->pattern);
+            free(h->style);
+            array_delete(_highlights.items, i);
+            array_free(pattern);
+            return;
+        }
+        i++;
+    }
+
+    yed_cerr("'%s' isn't highlighted", array_data(pattern));
+    array_free(pattern);
+}
+
+void find_regex_stats(int n_args, char **args) {
+    if (n_args > 1 || (n_args == 1 && strcmp(args[0], "reset") != 0)) {
+        yed_cerr("Expected zero arguments, or 'reset'.");
+        return;
+    }
+
+    if (n_args == 1) {
+        find_stats_reset();
+        if (_stats.is_enabled)
+            find_stats_publish();
+        return;
+    }
+
+    if (!_stats.is_enabled) {
+        yed_cerr("Stats are off, set find-regex-stats-enabled to true.");
+        return;
+    }
+
+    yed_cprint("compile %lld (%lld cached) %.2f ms | scan %lld lines, %lld matches %.2f ms | replace %lld lines %.2f ms | highlight %lld rows %.2f ms",
+               _stats.n_compiles, _stats.n_cache_hits, _stats.compile_ns / 1e6,
+               _stats.n_lines_scanned, _stats.n_matches, _stats.scan_ns / 1e6,
+               _stats.n_lines_replaced, _stats.replace_ns / 1e6,
+               _stats.n_highlights, _stats.highlight_ns / 1e6);
+}
+
 void find_unload(yed_plugin *self) {
-    matchframe *mf;
+    matchbuffer *mb;
+    char       **entry;
 
-    array_traverse(_matchframes, mf) {
-        array_free(mf->matches);
+    array_traverse(_matchbuffers, mb) {
+        find_matchbuffer_free(mb);
     }
-    array_free(_matchframes);
+    array_free(_matchbuffers);
+    array_free(_row_matches);
+    find_arena_free();
     array_free(_pattern);
+    array_traverse(_search_hist, entry) {
+        free(*entry);
+    }
     array_free(_search_hist);
     array_free(_replace_properties.replacement);
+    array_free(_replace_template.text);
+    array_free(_replace_template.pieces);
+    array_free(_confirm.text);
+    array_free(_replace_batch.rows);
+    array_free(_replace_batch.offsets);
+    array_free(_replace_batch.text);
     free(_search_readline);
-    regfree(&_regex);
+    find_project_search_stop();
+    array_free(_project_search.buffers);
+    array_free(_project_search.paths);
+    find_highlights_free();
+    find_compiled_free_all();
 }
 
 int yed_plugin_boot(yed_plugin *self) {
@@ -835,23 +5509,55 @@ int yed_plugin_boot(yed_plugin *self) {
 
     yed_plugin_set_unload_fn(self, find_unload);
 
-    _matchframes = array_make_with_cap(matchframe, FIND_DEFAULT_ARRAY_LEN);
+    _matchbuffers = array_make_with_cap(matchbuffer, FIND_DEFAULT_ARRAY_LEN);
+    _compiled_cache = array_make(find_compiled*);
+    _row_matches = array_make_with_cap(match, FIND_DEFAULT_ARRAY_LEN);
+    _arena.retired = array_make(char*);
     _pattern = array_make_with_cap(char, FIND_DEFAULT_ARRAY_LEN);
+    find_fold_tables_init();
     _replace_properties.replacement = array_make_with_cap(char, FIND_DEFAULT_ARRAY_LEN);
+    _replace_template.text = array_make_with_cap(char, FIND_DEFAULT_ARRAY_LEN);
+    _replace_template.pieces = array_make(replace_piece);
+    _confirm.text = array_make_with_cap(char, FIND_DEFAULT_ARRAY_LEN);
+    _replace_batch.rows = array_make(int);
+    _replace_batch.offsets = array_make(size_t);
+    _replace_batch.text = array_make_with_cap(char, FIND_DEFAULT_ARRAY_LEN);
+    _project_search.buffers = array_make(yed_buffer*);
+    _project_search.paths = array_make(char*);
+    _highlights.items = array_make(find_highlight);
 
     _search_hist     = array_make(char*);
     _search_readline = malloc(sizeof(*ys->search_readline));
     yed_cmd_line_readline_make(_search_readline, &_search_hist);
 
+    /* the search is drawn over the highlighted patterns */
     h.kind = EVENT_LINE_PRE_DRAW;
-    h.fn   = find_matchframe_highlight_handler;
+    h.fn   = find_highlights_handler;
     yed_plugin_add_event_handler(self, h);
 
-    /*
-     * TODO: Event handler for activating frame or loading frame, or otherwise
-     * changing the frame. Matches need to be highlighted in other frames for
-     * *any* search.
-     */
+    h.kind = EVENT_LINE_PRE_DRAW;
+    h.fn   = find_matchbuffer_highlight_handler;
+    yed_plugin_add_event_handler(self, h);
+
+    h.kind = EVENT_POST_PUMP;
+    h.fn   = find_pump_handler;
+    yed_plugin_add_event_handler(self, h);
+
+    h.kind = EVENT_BUFFER_PRE_MOD;
+    h.fn   = find_matchbuffer_buffer_pre_mod_handler;
+    yed_plugin_add_event_handler(self, h);
+
+    h.kind = EVENT_BUFFER_POST_MOD;
+    h.fn   = find_matchbuffer_buffer_mod_handler;
+    yed_plugin_add_event_handler(self, h);
+
+    h.kind = EVENT_KEY_PRESSED;
+    h.fn   = find_results_key_handler;
+    yed_plugin_add_event_handler(self, h);
+
+    h.kind = EVENT_BUFFER_PRE_DELETE;
+    h.fn   = find_matchbuffer_delete_handler;
+    yed_plugin_add_event_handler(self, h);
 
     if (!yed_get_var("find-regex-replace-default-commands"))
         yed_set_var("find-regex-replace-default-commands", "false");
@@ -861,6 +5567,31 @@ int yed_plugin_boot(yed_plugin *self) {
 
     if (!yed_get_var("find-regex-replace-prompt"))
         yed_set_var("find-regex-replace-prompt", FIND_DEFAULT_REPLACE_PROMPT);
+    if (!yed_get_var("find-regex-confirm-prompt"))
+        yed_set_var("find-regex-confirm-prompt", FIND_DEFAULT_CONFIRM_PROMPT);
+
+    if (!yed_get_var("find-regex-engine"))
+        yed_set_var("find-regex-engine", FIND_DEFAULT_ENGINE);
+
+    if (!yed_get_var("find-regex-threads"))
+        yed_set_var("find-regex-threads", FIND_DEFAULT_THREADS);
+    if (!yed_get_var("find-regex-max-matches"))
+        yed_set_var("find-regex-max-matches", FIND_DEFAULT_MAX_MATCHES);
+    if (!yed_get_var("find-regex-history-prefetch"))
+        yed_set_var("find-regex-history-prefetch", FIND_DEFAULT_HISTORY_PREFETCH);
+    if (!yed_get_var("find-regex-search-budget-ms"))
+        yed_set_var("find-regex-search-budget-ms", FIND_DEFAULT_SEARCH_BUDGET_MS);
+    if (!yed_get_var("find-regex-max-line-length"))
+        yed_set_var("find-regex-max-line-length", FIND_DEFAULT_MAX_LINE_LENGTH);
+
+    if (!yed_get_var("find-regex-background-budget-ms"))
+        yed_set_var("find-regex-background-budget-ms", FIND_DEFAULT_BACKGROUND_BUDGET_MS);
+
+    if (!yed_get_var("find-regex-smartcase"))
+        yed_set_var("find-regex-smartcase", "false");
+
+    if (!yed_get_var("find-regex-stats-enabled"))
+        yed_set_var("find-regex-stats-enabled", "false");
 
     if (!yed_get_var("find-regex-search-all-frames"))
         yed_set_var("find-regex-search-all-frames", "true");
@@ -871,6 +5602,16 @@ int yed_plugin_boot(yed_plugin *self) {
     yed_plugin_set_command(self, find_get_command(FIND_NEXT_IN_BUFFER), find_cursor_next_match);
     yed_plugin_set_command(self, find_get_command(FIND_PREV_IN_BUFFER), find_cursor_prev_match);
     yed_plugin_set_command(self, find_get_command(FIND_AND_REPLACE), find_regex_sed_replace);
+    yed_plugin_set_command(self, "find-in-all-buffers-regex", find_regex_search_all_buffers);
+    yed_plugin_set_command(self, "find-in-files-regex", find_regex_search_files);
+    yed_plugin_set_command(self, "find-in-file-regex", find_regex_search_file);
+    yed_plugin_set_command(self, "find-regex-replace-apply", find_regex_replace_apply);
+#ifdef FIND_HAVE_BENCH
+    yed_plugin_set_command(self, "find-regex-bench", find_regex_bench);
+#endif
+    yed_plugin_set_command(self, "find-regex-stats", find_regex_stats);
+    yed_plugin_set_command(self, "find-regex-highlight", find_regex_highlight);
+    yed_plugin_set_command(self, "find-regex-unhighlight", find_regex_unhighlight);
 
     return 0;
 }